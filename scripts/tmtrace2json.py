@@ -0,0 +1,137 @@
+#!/usr/bin/python
+
+# Converts the binary transaction trace written by sesc (tmTraceFile) into the
+# jsonl `instances' that plot_timeline.py and plot_p.py read. There is one
+# instance per atomic region (tm_begin to tm_end) and thread.
+
+import collections
+import sys,argparse
+import json
+import struct
+
+MAGIC = b'SESCTMT'
+RECORD = struct.Struct('<QQIIhhBBH')
+
+# TMTraceEvent in src/libll/TMTrace.h
+REGION_BEGIN    = 1
+REGION_END      = 2
+HTM_BEGIN       = 3
+HTM_ABORT       = 4
+HTM_COMMIT      = 5
+BEGIN_NACK      = 6
+COMMIT_NACK     = 7
+LOCK_REQUEST    = 8
+LOCK_ACQUIRE    = 9
+LOCK_RELEASE    = 10
+
+# TMAbortType_e in src/libTM/TMState.h
+ABORT_TYPES = { 0: 'conflict', 1: 'user', 2: 'syscall', 3: 'capacity', 4: 'nontm', 5: 'falsepos' }
+
+def read_records(f):
+    header = f.read(12)
+    if len(header) < 12 or header[0:7] != MAGIC:
+        raise Exception('not a sesc TM trace')
+    version = bytearray(header[7:8])[0]
+    (record_size,) = struct.unpack('<I', header[8:12])
+    if version != 1 or record_size != RECORD.size:
+        raise Exception('unsupported TM trace version %d (record size %d)' % (version, record_size))
+    while True:
+        data = f.read(RECORD.size)
+        if len(data) < RECORD.size:
+            break
+        (cycle, utid, pc, arg, pid, aborter, ev_type, abort_type, _) = RECORD.unpack(data)
+        yield (pid, ev_type, cycle, utid, pc, arg, aborter, abort_type)
+
+class region_state:
+    def __init__(self, pid, start_at):
+        self.pid        = pid
+        self.start_at   = start_at
+        self.attempts   = list()
+        self.begin_nacks= 0
+        self.commit_nacks= 0
+        self.htm_begin  = None
+        self.lock_request= None
+        self.lock_acquire= None
+    def add_attempt(self, attempt_type, start_at, end_at, **extra):
+        attempt = { 'type': attempt_type, 'start_at': start_at, 'end_at': end_at }
+        attempt.update(extra)
+        self.attempts.append(attempt)
+    def to_json(self, end_at):
+        return json.dumps({
+            'type':         'instances',
+            'pid':          self.pid,
+            'start_at':     self.start_at,
+            'end_at':       end_at,
+            'attempts':     self.attempts,
+            'begin_nacks':  self.begin_nacks,
+            'commit_nacks': self.commit_nacks,
+            # The trace has no read/write sets
+            'rset':         [],
+            'wset':         [],
+        })
+
+def convert(infile, out):
+    # The records of a thread are in order, threads are interleaved
+    regions = dict()
+    last_at = collections.defaultdict(int)
+    for (pid, ev_type, cycle, utid, pc, arg, aborter, abort_type) in read_records(infile):
+        last_at[pid] = cycle
+        region = regions.get(pid)
+        if ev_type == REGION_BEGIN or region is None:
+            if region is not None:
+                out.write(region.to_json(cycle) + '\n')
+            region = region_state(pid, cycle)
+            regions[pid] = region
+            if ev_type == REGION_BEGIN:
+                continue
+
+        if ev_type == REGION_END:
+            out.write(region.to_json(cycle) + '\n')
+            del regions[pid]
+        elif ev_type == HTM_BEGIN:
+            region.htm_begin = (cycle, utid)
+        elif ev_type == HTM_ABORT or ev_type == HTM_COMMIT:
+            if region.htm_begin is None:
+                continue
+            if ev_type == HTM_ABORT:
+                region.add_attempt('abort', region.htm_begin[0], cycle, utid=utid, pc=pc,
+                        abort_type=ABORT_TYPES.get(abort_type, 'unknown'), aborter=aborter)
+            else:
+                region.add_attempt('commit', region.htm_begin[0], cycle, utid=utid, pc=pc)
+            region.htm_begin = None
+        elif ev_type == BEGIN_NACK:
+            region.begin_nacks += 1
+        elif ev_type == COMMIT_NACK:
+            region.commit_nacks += 1
+        elif ev_type == LOCK_REQUEST:
+            region.lock_request = cycle
+        elif ev_type == LOCK_ACQUIRE:
+            if region.lock_request is not None:
+                region.add_attempt('lockQ', region.lock_request, cycle)
+            region.lock_request = None
+            region.lock_acquire = cycle
+        elif ev_type == LOCK_RELEASE:
+            if region.lock_acquire is not None:
+                region.add_attempt('lock', region.lock_acquire, cycle)
+            region.lock_acquire = None
+
+    # Regions still open at the end of the trace
+    for pid in sorted(regions.keys()):
+        out.write(regions[pid].to_json(last_at[pid]) + '\n')
+
+def main():
+    parser = argparse.ArgumentParser('Converts a binary sesc TM trace into attempts jsonl')
+    parser.add_argument('infile')
+    parser.add_argument('-o', '--outfile')
+
+    args = parser.parse_args()
+
+    with open(args.infile, 'rb') as f:
+        if args.outfile:
+            with open(args.outfile, 'w') as out:
+                convert(f, out)
+        else:
+            convert(f, sys.stdout)
+
+if __name__ == "__main__":
+    main()
@@ -15,13 +15,14 @@ FasTMAbort::FasTMAbort(const char tmStyle[], int32_t nProcs, int32_t line):
         flushMsg("tm:flushMsg"),
         fwdGetSConflictMsg("tm:fwdGetSConflictMsg"),
         invConflictMsg("tm:invConflictMsg"),
-        nackMsg("tm:nackMsg") {
+        nackMsg("tm:nackMsg"),
+        directory(line) {
 
     int totalSize = SescConf->getInt("TransactionalMemory", "totalSize");
     int assoc = SescConf->getInt("TransactionalMemory", "assoc");
 
     for(Pid_t pid = 0; pid < nProcs; pid++) {
-        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1));
+        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1, &directory, pid));
     }
 }
 
@@ -38,9 +39,9 @@ FasTMAbort::~FasTMAbort() {
 ///
 // We have a conflict, so either NACK pid (the requester), or if the requester is higher priority,
 // abort all conflicting
-TMRWStatus FasTMAbort::handleConflicts(Pid_t pid, VAddr caddr, std::set<Pid_t>& conflicting) {
+TMRWStatus FasTMAbort::handleConflicts(Pid_t pid, VAddr caddr, PidMask& conflicting) {
     Pid_t highestPid = INVALID_PID;
-    std::set<Pid_t> surviving;
+    PidMask surviving;
     for(Pid_t c: conflicting) {
         if(isHigherOrEqualPriority(pid, c)) {
             markTransAborted(c, pid, caddr, TM_ATYPE_DEFAULT);
@@ -81,9 +82,9 @@ FasTMAbort::Line* FasTMAbort::replaceLine(Pid_t pid, VAddr raddr) {
 ///
 // Helper function that aborts all transactional readers and writers
 TMRWStatus FasTMAbort::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except) {
-    set<Pid_t> conflicting;
-    rwSetManager.getWriters(caddr, conflicting);
+    PidMask conflicting = rwSetManager.getWriters(caddr);
     conflicting.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     // If any winners are around, we do conflict resolution
     if(conflicting.size() > 0) {
@@ -104,10 +105,9 @@ TMRWStatus FasTMAbort::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::se
 ///
 // Helper function that aborts all transactional readers and writers
 TMRWStatus FasTMAbort::abortTMSharers(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except) {
-    set<Pid_t> conflicting;
-    rwSetManager.getWriters(caddr, conflicting);
-    rwSetManager.getReaders(caddr, conflicting);
+    PidMask conflicting = rwSetManager.getSharers(caddr);
     conflicting.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     // If any winners are around, we do conflict resolution
     if(conflicting.size() > 0) {
@@ -132,7 +132,7 @@ void FasTMAbort::cleanDirtyLines(Pid_t pid, VAddr caddr, std::set<Cache*>& excep
     getSMsg.inc();
 
     Cache* myCache = getCache(pid);
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(caddr)) {
         Cache* cache = caches.at(cid);
         Line* line = cache->findLine(caddr);
         if(line && line->isValid() && line->isDirty()) {
@@ -166,7 +166,7 @@ void FasTMAbort::invalidateLines(Pid_t pid, VAddr caddr, std::set<Cache*>& excep
     getMMsg.inc();
 
     Cache* myCache = getCache(pid);
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(caddr)) {
         Cache* cache = caches.at(cid);
         Line* line = cache->findLine(caddr);
         if(line && line->isValid()) {
@@ -23,7 +23,7 @@ protected:
     virtual TMBCStatus myCommit(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus);
 
     Cache* getCache(Pid_t pid) { return caches.at(pid); }
-    TMRWStatus handleConflicts(Pid_t pid, VAddr caddr, std::set<Pid_t>& conflicting);
+    TMRWStatus handleConflicts(Pid_t pid, VAddr caddr, PidMask& conflicting);
     virtual bool isHigherOrEqualPriority(Pid_t pid, Pid_t conflictPid) = 0;
 
     Line* replaceLine(Pid_t pid, VAddr raddr);
@@ -48,6 +48,7 @@ protected:
 
     // State member variables
     std::vector<Cache*>         caches;
+    TMLineDirectory             directory;
 };
 
 class FasTMAbortMoreReadsWins: public FasTMAbort {
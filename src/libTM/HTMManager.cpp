@@ -12,6 +12,8 @@
 #include "LogTMManager.h"
 #include "FasTMManager.h"
 #include "PleaseTMManager.h"
+#include "SigTMManager.h"
+#include "LazyTMManager.h"
 
 using namespace std;
 
@@ -51,6 +53,10 @@ HTMManager *HTMManager::create(int32_t nCores) {
         newCohManager = new FasTMAbortMoreReadsWins("FasTM-Abort (More reads wins)", nCores, lineSize);
     } else if(method == "FasTM-Abort") {
         newCohManager = new FasTMAbortOlderWins("FasTM-Abort (Older wins)", nCores, lineSize);
+    } else if(method == "SigTM") {
+        newCohManager = new SigTMManager("SigTM", nCores, lineSize);
+    } else if(method == "LazyTM") {
+        newCohManager = new LazyTMManager("LazyTM", nCores, lineSize);
     } else {
         MSG("unknown TM method, using TSX");
         newCohManager = new TSXManager("TSX", nCores, lineSize);
@@ -66,13 +72,15 @@ HTMManager *HTMManager::create(int32_t nCores) {
 HTMManager::HTMManager(const char tmStyle[], int32_t procs, int32_t line):
         nCores(procs),
         lineSize(line),
+        trackRWSets(true),
         numCommits("tm:numCommits"),
         numAborts("tm:numAborts"),
         abortTypes("tm:abortTypes"),
         userAbortArgs("tm:userAbortArgs"),
         fallbackArgHist("tm:fallbackArgHist"),
         numFutileAborts("tm:numFutileAborts"),
-        numAbortsBeforeCommit("tm:numAbortsBeforeCommit") {
+        numAbortsBeforeCommit("tm:numAbortsBeforeCommit"),
+        subBlockConflictsAvoided("tm:subBlockConflictsAvoided") {
 
     if(SescConf->checkInt("TransactionalMemory","smtContexts")) {
         nSMTWays = SescConf->getInt("TransactionalMemory","smtContexts");
@@ -90,11 +98,29 @@ HTMManager::HTMManager(const char tmStyle[], int32_t procs, int32_t line):
         utids.push_back(INVALID_UTID);
     }
     rwSetManager.initialize(nThreads);
+    if(SescConf->checkInt("TransactionalMemory","conflictGranularity")) {
+        int granularity = SescConf->getInt("TransactionalMemory","conflictGranularity");
+        // SMT peers share the private cache of their core
+        rwSetManager.setSubBlocks(lineSize, granularity, nSMTWays);
+        if(rwSetManager.hasSubBlocks()) {
+            MSG("Detecting TM conflicts per %d bytes", granularity);
+        }
+        // Transactions may write other bytes of the lines they have
+        TMStorage2::mergeBytes = rwSetManager.hasSubBlocks();
+    }
+    scheduler = TMScheduler::create(nThreads);
+    profiler  = TMProfiler::create(nThreads);
 }
 ///
 // Entry point for TM begin operation. Check for nesting and then call the real begin.
 TMBCStatus HTMManager::begin(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus) {
     Pid_t pid   = context->getPid();
+
+    // The scheduler is not used in rabbit mode, where there is no timing
+    if(scheduler && !ThreadContext::skipping && !scheduler->canBegin(pid)) {
+        p_opStatus->tmBeginSubtype = TM_BEGIN_NACKED;
+        return TMBC_NACK;
+    }
     TMBCStatus status = myBegin(inst, context, p_opStatus);
 
     if(status == TMBC_SUCCESS) {
@@ -105,6 +131,12 @@ TMBCStatus HTMManager::begin(InstDesc* inst, const ThreadContext* context, InstC
         tmStates[pid].begin();
         abortStates.at(pid).clear();
         abortsCaused[pid] = 0;
+        p_opStatus->tmUtid = utids[pid];
+        if(profiler) {
+            // The atomic block is the tm_begin call, if there is one
+            VAddr site = context->getTMBeginSite();
+            profiler->begin(pid, site ? site : context->getIAddr(), context);
+        }
     }
     return status;
 }
@@ -115,8 +147,11 @@ TMBCStatus HTMManager::commit(InstDesc* inst, const ThreadContext* context, Inst
     Pid_t pid   = context->getPid();
     TMBCStatus status = TMBC_INVALID;
 
+    p_opStatus->tmUtid = getUtid(pid);
 	if(getTMState(pid) == TMStateEngine::TM_MARKABORT) {
         p_opStatus->tmCommitSubtype=TM_COMMIT_ABORTED;
+        p_opStatus->tmAbortType = abortStates.at(pid).getAbortType();
+        p_opStatus->tmAborterPid = abortStates.at(pid).getAborterPid();
 		status = TMBC_ABORT;
 	} else {
 		status = myCommit(inst, context, p_opStatus);
@@ -128,6 +163,12 @@ TMBCStatus HTMManager::commit(InstDesc* inst, const ThreadContext* context, Inst
         numAbortsBeforeCommit.sample(abortsSoFar[pid]);
 
         abortsSoFar[pid] = 0;
+        if(scheduler) {
+            scheduler->commit(pid);
+        }
+        if(profiler) {
+            profiler->commit(pid);
+        }
 
         tmStates.at(pid).clear();
         utids.at(pid) = INVALID_UTID;
@@ -137,50 +178,72 @@ TMBCStatus HTMManager::commit(InstDesc* inst, const ThreadContext* context, Inst
 }
 ///
 // Entry point for TM read operation. Checks transaction state and then calls the real read.
-TMRWStatus HTMManager::read(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+TMRWStatus HTMManager::read(InstDesc* inst, const ThreadContext* context, VAddr raddr, size_t size, InstContext* p_opStatus) {
     Pid_t pid   = context->getPid();
 	VAddr caddr = addrToCacheLine(raddr);
     TMRWStatus status = TMRW_INVALID;
 
 	if(getTMState(pid) == TMStateEngine::TM_MARKABORT) {
 		status = TMRW_ABORT;
-	} else if(getTMState(pid) == TMStateEngine::TM_INVALID) {
-        nonTMRead(inst, context, raddr, p_opStatus);
-        status = TMRW_NONTM;
 	} else {
-        status = TMRead(inst, context, raddr, p_opStatus);
+        // Conflicts are looked up for the sub-blocks of the access only
+        if(rwSetManager.hasSubBlocks()) {
+            rwSetManager.beginAccess(pid, caddr, rwSetManager.getSubBlockMask(raddr, size), false);
+        }
+        if(getTMState(pid) == TMStateEngine::TM_INVALID) {
+            nonTMRead(inst, context, raddr, p_opStatus);
+            status = TMRW_NONTM;
+        } else {
+            status = TMRead(inst, context, raddr, p_opStatus);
+        }
+        if(rwSetManager.hasSubBlocks()) {
+            countSubBlockAvoided(pid, rwSetManager.endAccess());
+        }
     }
 
     if(status == TMRW_SUCCESS) {
         if(getTMState(pid) != TMStateEngine::TM_RUNNING) {
             fail("%d in invalid state to do tm.load: %d", pid, getTMState(pid));
         }
-        rwSetManager.read(pid, caddr);
+        if(trackRWSets) {
+            rwSetManager.read(pid, caddr, rwSetManager.getSubBlockMask(raddr, size));
+        }
     }
     return status;
 }
 
 ///
 // Entry point for TM write operation. Checks transaction state and then calls the real write.
-TMRWStatus HTMManager::write(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+TMRWStatus HTMManager::write(InstDesc* inst, const ThreadContext* context, VAddr raddr, size_t size, InstContext* p_opStatus) {
     Pid_t pid   = context->getPid();
 	VAddr caddr = addrToCacheLine(raddr);
     TMRWStatus status = TMRW_INVALID;
 
 	if(getTMState(pid) == TMStateEngine::TM_MARKABORT) {
 		status = TMRW_ABORT;
-	} else if(getTMState(pid) == TMStateEngine::TM_INVALID) {
-        nonTMWrite(inst, context, raddr, p_opStatus);
-        status = TMRW_NONTM;
 	} else {
-        status = TMWrite(inst, context, raddr, p_opStatus);
+        // Conflicts are looked up for the sub-blocks of the access only
+        if(rwSetManager.hasSubBlocks()) {
+            rwSetManager.beginAccess(pid, caddr, rwSetManager.getSubBlockMask(raddr, size), true);
+        }
+        if(getTMState(pid) == TMStateEngine::TM_INVALID) {
+            nonTMWrite(inst, context, raddr, p_opStatus);
+            status = TMRW_NONTM;
+        } else {
+            status = TMWrite(inst, context, raddr, p_opStatus);
+        }
+        if(rwSetManager.hasSubBlocks()) {
+            countSubBlockAvoided(pid, rwSetManager.endAccess());
+        }
     }
 
     if(status == TMRW_SUCCESS) {
         if(getTMState(pid) != TMStateEngine::TM_RUNNING) {
             fail("%d in invalid state to do tm.store: %d", pid, getTMState(pid));
         }
-        rwSetManager.write(pid, caddr);
+        if(trackRWSets) {
+            rwSetManager.write(pid, caddr, rwSetManager.getSubBlockMask(raddr, size));
+        }
     }
     return status;
 }
@@ -239,9 +302,17 @@ TMBCStatus HTMManager::completeAbort(InstDesc* inst, const ThreadContext* contex
         numFutileAborts.inc();
         abortsCaused[pid] = 0;
     }
+    if(scheduler) {
+        scheduler->abort(pid);
+    }
+    if(profiler) {
+        profiler->abort(pid, abortState.getAbortType());
+    }
 
     p_opStatus->tmBeginSubtype=TM_COMPLETE_ABORT;
     p_opStatus->tmAbortType = abortStates.at(pid).getAbortType();
+    p_opStatus->tmAborterPid = abortState.getAborterPid();
+    p_opStatus->tmUtid = getUtid(pid);
     tmStates.at(pid).clear();
     utids.at(pid) = INVALID_UTID;
     rwSetManager.clear(pid);
@@ -260,22 +331,49 @@ void HTMManager::completeFallback(Pid_t pid) {
     fallbackArg.erase(pid);
 }
 
+void HTMManager::report(const char *str) const {
+    if(profiler) {
+        profiler->report(str);
+    }
+}
+
+///
+// Count the running transactions of skipped that only conflicted with pid at
+// line granularity
+void HTMManager::countSubBlockAvoided(Pid_t pid, const PidMask& skipped) {
+    for(Pid_t p: skipped) {
+        if(p != pid && getTMState(p) == TMStateEngine::TM_RUNNING) {
+            subBlockConflictsAvoided.inc();
+        }
+    }
+}
+
+CacheAssocTM* HTMManager::getCache(Pid_t pid) {
+    fail("This TM method does not model private caches\n");
+    return NULL;
+}
+
+void HTMManager::addSubBlockSharers(VAddr caddr, std::set<CacheAssocTM*>& except) {
+    for(Pid_t other: rwSetManager.getSubBlockSharers(caddr)) {
+        except.insert(getCache(other));
+    }
+}
+
 void HTMManager::markTransAborted(Pid_t victimPid, Pid_t aborterPid, VAddr caddr, TMAbortType_e abortType) {
     uint64_t aborterUtid = getUtid(aborterPid);
 
     if(getTMState(victimPid) != TMStateEngine::TM_ABORTING && getTMState(victimPid) != TMStateEngine::TM_MARKABORT) {
         tmStates.at(victimPid).markAbort();
         abortStates.at(victimPid).markAbort(aborterPid, aborterUtid, caddr, abortType);
+        if(profiler) {
+            profiler->markAbort(victimPid, aborterPid, caddr);
+        }
     } // Else victim is already aborting, so leave it alone
 }
 
-void HTMManager::markTransAborted(std::set<Pid_t>& aborted, Pid_t aborterPid, VAddr caddr, TMAbortType_e abortType) {
-	set<Pid_t>::iterator i_aborted;
-    for(i_aborted = aborted.begin(); i_aborted != aborted.end(); ++i_aborted) {
-		if(*i_aborted == INVALID_PID) {
-            fail("Trying to abort invalid Pid?");
-        }
-        markTransAborted(*i_aborted, aborterPid, caddr, abortType);
+void HTMManager::markTransAborted(const PidMask& aborted, Pid_t aborterPid, VAddr caddr, TMAbortType_e abortType) {
+    for(Pid_t a: aborted) {
+        markTransAborted(a, aborterPid, caddr, abortType);
 	}
 }
 
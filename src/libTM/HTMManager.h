@@ -11,14 +11,17 @@
 #include "libemul/InstDesc.h"
 #include "TMState.h"
 #include "RWSetManager.h"
+#include "TMScheduler.h"
+#include "TMProfiler.h"
 
 // Forward defs instead of ThreadContext.h
 class ThreadContext;
 class InstContext;
+class CacheAssocTM;
 
 class HTMManager {
 public:
-    virtual ~HTMManager() { }
+    virtual ~HTMManager() { delete scheduler; delete profiler; }
     
     // Factory method
     static HTMManager *create(int32_t nCores);
@@ -26,8 +29,8 @@ public:
     // Entry point functions for TM operations
     TMBCStatus begin(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus);
     TMBCStatus commit(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus);
-    TMRWStatus read(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
-    TMRWStatus write(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
+    TMRWStatus read(InstDesc* inst, const ThreadContext* context, VAddr raddr, size_t size, InstContext* p_opStatus);
+    TMRWStatus write(InstDesc* inst, const ThreadContext* context, VAddr raddr, size_t size, InstContext* p_opStatus);
 
     // Entry point for TM abort operations
     void startAborting(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus);
@@ -39,6 +42,9 @@ public:
     virtual void beginFallback(Pid_t pid, uint32_t arg);
     virtual void completeFallback(Pid_t pid);
 
+    // Report the statistics that are not GStats (abortProfiler)
+    void report(const char *str) const;
+
     // Query functions
     VAddr addrToCacheLine(VAddr raddr) {
         while(raddr % lineSize != 0) {
@@ -51,13 +57,21 @@ public:
     uint64_t getUtid(Pid_t pid)     const { return utids.at(pid); }
 
     virtual uint32_t getNackRetryStallCycles(ThreadContext* context) { return 0; }
+    // Stall before retrying a tm.begin delayed by the transaction scheduler
+    uint32_t getBeginRetryStallCycles() const { return scheduler ? scheduler->getRetryCycles() : 0; }
 
 protected:
     HTMManager(const char* tmStyle, int procs, int line);
 
     // Mark a transaction (or set of transactions) as aborted.
     void markTransAborted(Pid_t victimPid, Pid_t aborterPid, VAddr caddr, TMAbortType_e abortType);
-    void markTransAborted(std::set<Pid_t>& aborted, Pid_t aborterPid, VAddr caddr, TMAbortType_e abortType);
+    void markTransAborted(const PidMask& aborted, Pid_t aborterPid, VAddr caddr, TMAbortType_e abortType);
+    // Sub-block conflict detection (conflictGranularity) statistics
+    void countSubBlockAvoided(Pid_t pid, const PidMask& skipped);
+    // Private cache of pid, for the methods that model the caches
+    virtual CacheAssocTM* getCache(Pid_t pid);
+    // Threads that only accessed other sub-blocks of caddr keep their copies
+    void addSubBlockSharers(VAddr caddr, std::set<CacheAssocTM*>& except);
 
     // Interface for child classes to override and actually implement the TM OP
     virtual TMBCStatus myBegin(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus);
@@ -77,6 +91,13 @@ protected:
     int             lineSize;
 
     RWSetManager    rwSetManager;
+    // Exact read/write sets are kept for the successful accesses (managers
+    // that detect conflicts on their own may turn this off)
+    bool            trackRWSets;
+    // Optional contention manager in front of begin (NULL if disabled)
+    TMScheduler     *scheduler;
+    // Optional per atomic block abort profiler (NULL if disabled)
+    TMProfiler      *profiler;
     std::vector<struct TMStateEngine> tmStates;
     std::vector<TMAbortState>       abortStates;
     // The unique identifier for each tnx instance
@@ -93,6 +114,8 @@ protected:
     GStatsHist      fallbackArgHist;
     GStatsCntr      numFutileAborts;
     GStatsHist      numAbortsBeforeCommit;
+    // Conflicts at line granularity that were not conflicts per sub-block
+    GStatsCntr      subBlockConflictsAvoided;
 
     std::map<Pid_t, size_t>   abortsSoFar;
     std::map<Pid_t, size_t>   abortsCaused;
@@ -17,13 +17,14 @@ IdealTSXManager::IdealTSXManager(const char tmStyle[], int32_t nCores, int32_t l
         invMsg("tm:invMsg"),
         flushMsg("tm:flushMsg"),
         fwdGetSConflictMsg("tm:fwdGetSConflictMsg"),
-        invConflictMsg("tm:invConflictMsg") {
+        invConflictMsg("tm:invConflictMsg"),
+        directory(line) {
 
     int totalSize = SescConf->getInt("TransactionalMemory", "totalSize");
     int assoc = SescConf->getInt("TransactionalMemory", "assoc");
 
     for(int coreId = 0; coreId < nCores; coreId++) {
-        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1));
+        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1, &directory, coreId));
     }
 }
 
@@ -61,9 +62,9 @@ IdealTSXManager::Line* IdealTSXManager::replaceLine(Pid_t pid, VAddr raddr) {
 // Helper function that aborts all transactional readers
 void IdealTSXManager::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except) {
     // Collect writers
-    set<Pid_t> aborted;
-    rwSetManager.getWriters(caddr, aborted);
+    PidMask aborted = rwSetManager.getWriters(caddr);
     aborted.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     TMAbortType_e abortType = isTM ? TM_ATYPE_DEFAULT : TM_ATYPE_NONTM;
 
@@ -86,10 +87,9 @@ void IdealTSXManager::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::set
 // Helper function that aborts all transactional readers and writers
 void IdealTSXManager::abortTMSharers(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except) {
     // Collect sharers
-    set<Pid_t> aborted;
-    rwSetManager.getWriters(caddr, aborted);
-    rwSetManager.getReaders(caddr, aborted);
+    PidMask aborted = rwSetManager.getSharers(caddr);
     aborted.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     TMAbortType_e abortType = isTM ? TM_ATYPE_DEFAULT : TM_ATYPE_NONTM;
 
@@ -112,7 +112,7 @@ void IdealTSXManager::cleanDirtyLines(Pid_t pid, VAddr caddr, std::set<Cache*>&
     getSMsg.inc();
 
     Cache* myCache = getCache(pid);
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(caddr)) {
         Cache* cache = caches.at(cid);
         Line* line = cache->findLine(caddr);
         if(line && line->isValid() && line->isDirty()) {
@@ -138,7 +138,7 @@ void IdealTSXManager::invalidateLines(Pid_t pid, VAddr caddr, std::set<Cache*>&
     getMMsg.inc();
 
     Cache* myCache = getCache(pid);
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(caddr)) {
         Cache* cache = caches.at(cid);
         Line* line = cache->findLine(caddr);
         if(line && line->isValid()) {
@@ -44,6 +44,7 @@ protected:
 
     // State member variables
     std::vector<Cache*>         caches;
+    TMLineDirectory             directory;
 };
 
 #endif
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <string.h>
+#include "nanassert.h"
+#include "SescConf.h"
+#include "libemul/EmulInit.h"
+#include "libll/ThreadContext.h"
+#include "LazyTMManager.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Lazy HTM (commit-time conflict detection, committer wins)
+/////////////////////////////////////////////////////////////////////////////////////////
+LazyTMManager::LazyTMManager(const char tmStyle[], int32_t nCores, int32_t line):
+        HTMManager(tmStyle, nCores, line),
+        commitMode(CommitToken),
+        arbitrationLat(0),
+        commitBandwidth(1),
+        commitNacks("tm:commitNacks"),
+        commitAborts("tm:commitAborts"),
+        commitWriteLines("tm:commitWriteLines") {
+
+    if(SescConf->checkCharPtr("TransactionalMemory", "commitArbitration")) {
+        const char *mode = SescConf->getCharPtr("TransactionalMemory", "commitArbitration");
+        if(strcasecmp(mode, "Token") == 0) {
+            commitMode = CommitToken;
+        } else if(strcasecmp(mode, "Parallel") == 0) {
+            commitMode = CommitParallel;
+        } else {
+            fail("Unknown commitArbitration %s (Token or Parallel)\n", mode);
+        }
+    }
+    if(SescConf->checkInt("TransactionalMemory", "commitArbitrationLat")) {
+        arbitrationLat = SescConf->getInt("TransactionalMemory", "commitArbitrationLat");
+    }
+    if(SescConf->checkInt("TransactionalMemory", "commitBandwidth")) {
+        commitBandwidth = SescConf->getInt("TransactionalMemory", "commitBandwidth");
+        if(commitBandwidth == 0) {
+            fail("commitBandwidth can not be 0\n");
+        }
+    }
+    MSG("Lazy TM %s commit: arbitration %u cycles, %u lines/cycle",
+        commitMode == CommitToken ? "token" : "parallel", arbitrationLat, commitBandwidth);
+
+    commitDoneAt.resize(nThreads, 0);
+    commitLines.resize(nThreads);
+    retryAt.resize(nThreads, 0);
+}
+
+LazyTMManager::~LazyTMManager() {
+}
+
+///
+// Stall a NACKed commit until the commit that blocked it completes
+uint32_t LazyTMManager::getNackRetryStallCycles(ThreadContext* context) {
+    Time_t until = retryAt.at(context->getPid());
+    return until > globalClock ? until - globalClock : 1;
+}
+
+///
+// Helper function that returns a thread whose commit is still in flight and
+// blocks the commit of pid (the token holder, or a commit that shares a
+// written line), or INVALID_PID.
+Pid_t LazyTMManager::findBlockingCommit(Pid_t pid) const {
+    const vector<VAddr>& lines = rwSetManager.getLinesWritten(pid);
+
+    for(Pid_t other = 0; other < (Pid_t)nThreads; other++) {
+        if(other == pid || commitDoneAt[other] <= globalClock) {
+            continue;
+        }
+        if(commitMode == CommitToken) {
+            return other;
+        }
+        const vector<VAddr>& otherLines = commitLines[other];
+        for(VAddr caddr: lines) {
+            if(binary_search(otherLines.begin(), otherLines.end(), caddr)) {
+                return other;
+            }
+        }
+    }
+    return INVALID_PID;
+}
+
+///
+// Helper function that aborts the running transactions (other than pid) that
+// read or wrote caddr
+void LazyTMManager::abortSharers(Pid_t pid, VAddr caddr, TMAbortType_e abortType) {
+    PidMask sharers = rwSetManager.getSharers(caddr);
+    sharers.erase(pid);
+
+    for(Pid_t victim: sharers) {
+        if(getTMState(victim) == TMStateEngine::TM_RUNNING) {
+            commitAborts.inc();
+            markTransAborted(victim, pid, caddr, abortType);
+        }
+    }
+}
+
+///
+// Do a transactional read. Conflicts are detected at commit.
+TMRWStatus LazyTMManager::TMRead(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+    p_opStatus->wasHit = false;
+    return TMRW_SUCCESS;
+}
+
+///
+// Do a transactional write. The data stays in the TMContext until commit.
+TMRWStatus LazyTMManager::TMWrite(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+    p_opStatus->wasHit = false;
+    return TMRW_SUCCESS;
+}
+
+///
+// Do a non-transactional read. Speculative data is not visible, so there is
+// no conflict.
+void LazyTMManager::nonTMRead(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+    p_opStatus->wasHit = false;
+}
+
+///
+// Do a non-transactional write, it behaves as a single line commit.
+void LazyTMManager::nonTMWrite(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+    abortSharers(context->getPid(), addrToCacheLine(raddr), TM_ATYPE_NONTM);
+    p_opStatus->wasHit = false;
+}
+
+///
+// Arbitrate the commit and abort the transactions that conflict with the
+// write set. In rabbit mode there is no timing and commits never NACK.
+TMBCStatus LazyTMManager::myCommit(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus) {
+    Pid_t pid   = context->getPid();
+
+    if(!ThreadContext::skipping) {
+        Pid_t blocker = findBlockingCommit(pid);
+        if(blocker != INVALID_PID) {
+            commitNacks.inc();
+            retryAt[pid] = commitDoneAt[blocker];
+            p_opStatus->tmCommitSubtype = TM_COMMIT_NACKED;
+            return TMBC_NACK;
+        }
+    }
+
+    const vector<VAddr>& lines = rwSetManager.getLinesWritten(pid);
+    for(VAddr caddr: lines) {
+        if(rwSetManager.hasSubBlocks()) {
+            rwSetManager.beginAccess(pid, caddr, rwSetManager.getWriteMask(pid, caddr), true);
+            abortSharers(pid, caddr, TM_ATYPE_DEFAULT);
+            countSubBlockAvoided(pid, rwSetManager.endAccess());
+        } else {
+            abortSharers(pid, caddr, TM_ATYPE_DEFAULT);
+        }
+    }
+    commitWriteLines.sample(lines.size());
+
+    p_opStatus->tmLat           = arbitrationLat + 4 + (lines.size() + commitBandwidth - 1) / commitBandwidth;
+    p_opStatus->tmCommitSubtype = TM_COMMIT_REGULAR;
+
+    if(!ThreadContext::skipping) {
+        commitDoneAt[pid] = globalClock + p_opStatus->tmLat;
+        if(commitMode == CommitParallel) {
+            commitLines[pid] = lines;
+            sort(commitLines[pid].begin(), commitLines[pid].end());
+        }
+    }
+
+    return TMBC_SUCCESS;
+}
@@ -0,0 +1,58 @@
+#ifndef LAZYTM_MANAGER
+#define LAZYTM_MANAGER
+
+#include <vector>
+#include "HTMManager.h"
+
+///
+// Lazy versioning, lazy conflict detection HTM (TCC/Bulk-like). Reads and
+// writes only add the line to the read/write sets of the thread, and the
+// writes stay in the TMContext storage until commit. A commit aborts the
+// running transactions that read or wrote a line of its write set
+// (committer wins). Commits are arbitrated with:
+//   Token:    one commit at a time, a commit NACKs while another one is in
+//             flight.
+//   Parallel: commits proceed concurrently unless their write sets overlap.
+// Non-transactional writes abort the transactions that accessed the line.
+class LazyTMManager: public HTMManager {
+public:
+    enum CommitMode { CommitToken, CommitParallel };
+
+    LazyTMManager(const char tmStyle[], int32_t nCores, int32_t line);
+    virtual ~LazyTMManager();
+
+    virtual uint32_t getNackRetryStallCycles(ThreadContext* context);
+
+protected:
+    virtual TMRWStatus TMRead(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
+    virtual TMRWStatus TMWrite(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
+    virtual void       nonTMRead(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
+    virtual void       nonTMWrite(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
+    virtual TMBCStatus myCommit(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus);
+
+    // Helper functions
+    Pid_t findBlockingCommit(Pid_t pid) const;
+    void abortSharers(Pid_t pid, VAddr caddr, TMAbortType_e abortType);
+
+    // Configurable member variables
+    CommitMode      commitMode;
+    // Cycles to get the token or to reach the directories over the NoC
+    uint32_t        arbitrationLat;
+    // Lines of the write set sent per cycle at commit
+    uint32_t        commitBandwidth;
+
+    // Statistics
+    GStatsCntr      commitNacks;
+    GStatsCntr      commitAborts;
+    GStatsAvg       commitWriteLines;
+
+    // State member variables
+    // Cycle in which the last commit of each thread completes
+    std::vector<Time_t>                 commitDoneAt;
+    // Sorted write set of the last commit of each thread (Parallel)
+    std::vector<std::vector<VAddr> >    commitLines;
+    // Cycle in which a NACKed commit can be retried
+    std::vector<Time_t>                 retryAt;
+};
+
+#endif
@@ -15,7 +15,8 @@ IdealLogTM::IdealLogTM(const char tmStyle[], int32_t nProcs, int32_t line):
         flushMsg("tm:flushMsg"),
         fwdGetSConflictMsg("tm:fwdGetSConflictMsg"),
         invConflictMsg("tm:invConflictMsg"),
-        nackMsg("tm:nackMsg") {
+        nackMsg("tm:nackMsg"),
+        directory(line) {
 
     int totalSize = SescConf->getInt("TransactionalMemory", "totalSize");
     int assoc = SescConf->getInt("TransactionalMemory", "assoc");
@@ -31,7 +32,7 @@ IdealLogTM::IdealLogTM(const char tmStyle[], int32_t nProcs, int32_t line):
     MSG("Using seed %d with %d/%d", randomSeed, nackBase, nackCap);
 
     for(Pid_t pid = 0; pid < nProcs; pid++) {
-        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1));
+        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1, &directory, pid));
     }
 }
 
@@ -73,7 +74,7 @@ bool IdealLogTM::isHigherOrEqualPriority(Pid_t pid, Pid_t conflictPid) {
 
 ///
 // We have a conflict, so either NACK pid (the requester), or if there is a circular NACK, abort
-TMRWStatus IdealLogTM::handleConflicts(Pid_t pid, VAddr caddr, std::set<Pid_t>& conflicting) {
+TMRWStatus IdealLogTM::handleConflicts(Pid_t pid, VAddr caddr, PidMask& conflicting) {
     Pid_t highestPid = INVALID_PID;
     Pid_t higherPid = INVALID_PID;
     for(Pid_t c: conflicting) {
@@ -123,9 +124,9 @@ IdealLogTM::Line* IdealLogTM::replaceLine(Pid_t pid, VAddr raddr) {
 ///
 // Helper function that aborts all transactional readers and writers
 TMRWStatus IdealLogTM::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except) {
-    set<Pid_t> conflicting;
-    rwSetManager.getWriters(caddr, conflicting);
+    PidMask conflicting = rwSetManager.getWriters(caddr);
     conflicting.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     // If any winners are around, we self abort and add them to the except set
     if(conflicting.size() > 0) {
@@ -146,10 +147,9 @@ TMRWStatus IdealLogTM::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::se
 ///
 // Helper function that aborts all transactional readers and writers
 TMRWStatus IdealLogTM::abortTMSharers(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except) {
-    set<Pid_t> conflicting;
-    rwSetManager.getWriters(caddr, conflicting);
-    rwSetManager.getReaders(caddr, conflicting);
+    PidMask conflicting = rwSetManager.getSharers(caddr);
     conflicting.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     // If any winners are around, we self abort and add them to the except set
     if(conflicting.size() > 0) {
@@ -172,7 +172,7 @@ TMRWStatus IdealLogTM::abortTMSharers(Pid_t pid, VAddr caddr, bool isTM, std::se
 void IdealLogTM::cleanDirtyLines(VAddr raddr, std::set<Cache*>& except) {
     getSMsg.inc();
 
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(raddr)) {
         Cache* cache = caches.at(cid);
         if(except.find(cache) == except.end()) {
             Line* line = cache->findLine(raddr);
@@ -193,7 +193,7 @@ void IdealLogTM::cleanDirtyLines(VAddr raddr, std::set<Cache*>& except) {
 void IdealLogTM::invalidateLines(VAddr raddr, std::set<Cache*>& except) {
     getMMsg.inc();
 
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(raddr)) {
         Cache* cache = caches.at(cid);
         if(except.find(cache) == except.end()) {
             Line* line = cache->findLine(raddr);
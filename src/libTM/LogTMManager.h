@@ -26,7 +26,7 @@ protected:
     virtual void completeFallback(Pid_t pid);
 
     Cache* getCache(Pid_t pid) { return caches.at(pid); }
-    TMRWStatus handleConflicts(Pid_t pid, VAddr caddr, std::set<Pid_t>& conflicting);
+    TMRWStatus handleConflicts(Pid_t pid, VAddr caddr, PidMask& conflicting);
     virtual bool isHigherOrEqualPriority(Pid_t pid, Pid_t conflictPid);
     Time_t getStartTime(Pid_t pid)   const { return startTime.at(pid); }
 
@@ -59,6 +59,7 @@ protected:
 
     // State member variables
     std::vector<Cache*>         caches;
+    TMLineDirectory             directory;
 
     std::map<Pid_t, bool>               cycleFlags;
     std::map<Pid_t, Time_t>             startTime;
@@ -17,19 +17,15 @@ PleaseTM::PleaseTM(const char tmStyle[], int32_t nCores, int32_t line):
         fwdGetSConflictMsg("tm:fwdGetSConflictMsg"),
         invConflictMsg("tm:invConflictMsg"),
         rfchSuccMsg("tm:rfchSuccMsg"),
-        rfchFailMsg("tm:rfchFailMsg") {
+        rfchFailMsg("tm:rfchFailMsg"),
+        directory(line),
+        overflow(nThreads, line) {
 
     int totalSize = SescConf->getInt("TransactionalMemory", "totalSize");
     int assoc = SescConf->getInt("TransactionalMemory", "assoc");
-    if(SescConf->checkInt("TransactionalMemory","overflowSize")) {
-        maxOverflowSize = SescConf->getInt("TransactionalMemory","overflowSize");
-    } else {
-        maxOverflowSize = 4;
-        MSG("Using default overflow size of %ld\n", maxOverflowSize);
-    }
 
     for(int coreId = 0; coreId < nCores; coreId++) {
-        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1));
+        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1, &directory, coreId));
     }
 }
 
@@ -50,9 +46,7 @@ void PleaseTM::updateOverflow(Pid_t pid, VAddr newCaddr) {
     getPeers(pid, peers);
 
     for(Pid_t peer: peers) {
-        if(overflow[peer].find(newCaddr) != overflow[peer].end()) {
-            overflow[peer].erase(newCaddr);
-        }
+        overflow.remove(peer, newCaddr);
     }
 }
 
@@ -87,12 +81,13 @@ PleaseTM::Line* PleaseTM::replaceLine(Pid_t pid, VAddr raddr) {
             // Dirty transactional lines always trigger set conflict
             markTransAborted(replaced->getWriter(), pid, replaced->getCaddr(), TM_ATYPE_SETCONFLICT);
         } else {
-            // Clean lines only do so on overflow set overflows
+            // Clean lines only do so on overflow set overflows. An overflow
+            // signature replaces the exact read set for the line.
             for(Pid_t reader: replaced->getReaders()) {
-                if(overflow[reader].size() < maxOverflowSize) {
-                    overflow[reader].insert(replaced->getCaddr());
-                } else {
+                if(overflow.insert(reader, replaced->getCaddr()) == false) {
                     markTransAborted(reader, pid, replaced->getCaddr(), TM_ATYPE_SETCONFLICT);
+                } else if(overflow.usesSignature()) {
+                    rwSetManager.dropRead(reader, replaced->getCaddr());
                 }
             }
         }
@@ -109,8 +104,8 @@ PleaseTM::Line* PleaseTM::replaceLine(Pid_t pid, VAddr raddr) {
 
 ///
 // Collect transactions that would be aborted and remove from conflicting.
-void PleaseTM::handleConflicts(Pid_t pid, VAddr caddr, bool isTM, set<Pid_t>& conflicting) {
-    set<Pid_t> winners, losers;
+void PleaseTM::handleConflicts(Pid_t pid, VAddr caddr, bool isTM, PidMask& conflicting) {
+    PidMask winners, losers;
     for(Pid_t c: conflicting) {
         if(isTM == false || shouldAbort(pid, caddr, c)) {
             losers.insert(c);
@@ -133,9 +128,9 @@ void PleaseTM::handleConflicts(Pid_t pid, VAddr caddr, bool isTM, set<Pid_t>& co
 ///
 // Helper function that aborts all transactional readers and writers
 void PleaseTM::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except, InstContext* p_opStatus) {
-    set<Pid_t> conflicting;
-    rwSetManager.getWriters(caddr, conflicting);
+    PidMask conflicting = rwSetManager.getWriters(caddr);
     conflicting.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     handleConflicts(pid, caddr, isTM, conflicting);
 
@@ -150,10 +145,11 @@ void PleaseTM::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*
 ///
 // Helper function that aborts all transactional readers and writers
 void PleaseTM::abortTMSharers(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except, InstContext* p_opStatus) {
-    set<Pid_t> conflicting;
-    rwSetManager.getWriters(caddr, conflicting);
-    rwSetManager.getReaders(caddr, conflicting);
+    PidMask conflicting = rwSetManager.getSharers(caddr);
+    // Readers of overflowed lines are only in the overflow signatures
+    overflow.getSigHits(pid, caddr, conflicting);
     conflicting.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     handleConflicts(pid, caddr, isTM, conflicting);
 
@@ -172,7 +168,7 @@ void PleaseTM::cleanDirtyLines(Pid_t pid, VAddr caddr, std::set<Cache*>& except)
     getSMsg.inc();
 
     Cache* myCache = getCache(pid);
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(caddr)) {
         Cache* cache = caches.at(cid);
         Line* line = cache->findLine(caddr);
         if(line && line->isValid() && line->isDirty()) {
@@ -203,7 +199,7 @@ void PleaseTM::invalidateLines(Pid_t pid, VAddr caddr, std::set<Cache*>& except)
     getMMsg.inc();
 
     Cache* myCache = getCache(pid);
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(caddr)) {
         Cache* cache = caches.at(cid);
         Line* line = cache->findLine(caddr);
         if(line && line->isValid()) {
@@ -364,7 +360,7 @@ TMBCStatus PleaseTM::myCommit(InstDesc* inst, const ThreadContext* context, Inst
     for(Line* line: lines) {
         line->clearTransactional(pid);
     }
-    overflow[pid].clear();
+    overflow.clear(pid);
 
     return TMBC_SUCCESS;
 }
@@ -385,7 +381,7 @@ void PleaseTM::myStartAborting(InstDesc* inst, const ThreadContext* context, Ins
             line->clearTransactional(pid);
         }
     }
-    overflow[pid].clear();
+    overflow.clear(pid);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////
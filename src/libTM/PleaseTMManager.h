@@ -6,6 +6,7 @@
 #include <vector>
 #include "HTMManager.h"
 #include "PrivateCache.h"
+#include "TMOverflow.h"
 
 class PleaseTM: public HTMManager {
 public:
@@ -31,13 +32,12 @@ protected:
     void invalidateLines(Pid_t pid, VAddr caddr, std::set<Cache*>& except);
     void abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except, InstContext* p_opStatus);
     void abortTMSharers(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except, InstContext* p_opStatus);
-    void handleConflicts(Pid_t pid, VAddr caddr, bool isTM, std::set<Pid_t>& conflicting);
+    void handleConflicts(Pid_t pid, VAddr caddr, bool isTM, PidMask& conflicting);
     virtual bool shouldAbort(Pid_t pid, VAddr raddr, Pid_t other) = 0;
 
     // Configurable member variables
     int             totalSize;
     int             assoc;
-    size_t          maxOverflowSize;
 
     // Statistics
     GStatsCntr      getSMsg;
@@ -52,7 +52,8 @@ protected:
 
     // State member variables
     std::vector<Cache*>         caches;
-    std::map<Pid_t, std::set<VAddr> >   overflow;
+    TMLineDirectory             directory;
+    TMOverflowSet               overflow;
 };
 
 class PTMRequesterLoses: public PleaseTM {
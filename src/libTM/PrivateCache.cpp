@@ -1,5 +1,6 @@
 #include <cmath>
 #include <algorithm>
+#include <string.h>
 #include "libsuc/nanassert.h"
 #include "libemul/EmulInit.h"
 #include "SescConf.h"
@@ -15,54 +16,60 @@ void TMLine::addReader(Pid_t reader) {
     if(isValid() == false) {
         fail("trying to add reader to invalid line\n");
     }
-    if(!transactional) {
+    if(!isTransactional()) {
         fail("A non-TM line should not add reader\n");
     }
     if(tmWriter != INVALID_PID && !isReader(reader)) {
         fail("A written line should be cleaned first\n");
     }
-    tmReaders.insert(reader);
+    readers[reader >> 6] |= ((uint64_t)1) << (reader & 63);
 }
 void TMLine::makeDirty() {
-    if(transactional) {
+    if(isTransactional()) {
         fail("A transactional line should use transactionalDirty\n");
     }
-    dirty = true;
+    *flags |= TMLINE_DIRTY;
 }
 void TMLine::makeTransactionalDirty(Pid_t writer) {
     if(isValid() == false) {
         fail("trying to mark TMDirty to invalid line\n");
     }
-    if(!transactional) {
+    if(!isTransactional()) {
         fail("A non-TM line should use dirty\n");
     }
     if(tmWriter != INVALID_PID && !isWriter(writer)) {
         fail("Cannot have multiple writers\n");
     }
-    
-    tmReaders.insert(writer);
+
+    readers[writer >> 6] |= ((uint64_t)1) << (writer & 63);
     tmWriter = writer;
-    dirty = true;
+    *flags |= TMLINE_DIRTY;
 }
 void TMLine::makeClean() {
     tmWriter = INVALID_PID;
-    dirty = false;
+    *flags &= ~TMLINE_DIRTY;
 }
 void TMLine::clearTransactional(Pid_t p) {
-    tmReaders.erase(p);
+    readers[p >> 6] &= ~(((uint64_t)1) << (p & 63));
     if(isWriter(p)) {
         tmWriter = INVALID_PID;
-        dirty = false;
+        *flags &= ~TMLINE_DIRTY;
     }
-    if(tmReaders.empty() && tmWriter == INVALID_PID) {
-        transactional = false;
+    if(tmWriter == INVALID_PID) {
+        uint64_t any = 0;
+        for(size_t w = 0; w < PidMask::getNumWords(); w++) {
+            any |= readers[w];
+        }
+        if(any == 0) {
+            *flags &= ~TMLINE_TRANSACTIONAL;
+        }
     }
 }
-void TMLine::getAccessors(std::set<Pid_t>& accessors) const {
+void TMLine::getAccessors(PidMask& accessors) const {
     if(tmWriter != INVALID_PID) {
         accessors.insert(tmWriter);
     }
-    accessors.insert(tmReaders.begin(), tmReaders.end());
+    accessors.orWords(readers);
 }
 void TMLine::validate(VAddr t, VAddr c) {
     if(isValid()) {
@@ -74,16 +81,22 @@ void TMLine::validate(VAddr t, VAddr c) {
     if(c == 0) {
         fail("New caddr should not be null\n");
     }
-    setTag(t);
-    caddr = c;
+    *tag   = t;
+    *flags = TMLINE_VALID;
+    caddr  = c;
+    if(directory) {
+        directory->addHolder(t, cacheId);
+    }
 }
 void TMLine::invalidate() {
-    dirty           = false;
-    transactional   = false;
+    if(directory && isValid()) {
+        directory->removeHolder(*tag, cacheId);
+    }
+    *tag            = 0;
+    *flags          = 0;
     caddr           = INVALID_CADDR;
     tmWriter        = INVALID_PID;
-    tmReaders.clear();
-    StateGeneric::invalidate();
+    memset(readers, 0, PidMask::getNumWords() * sizeof(uint64_t));
 }
 
 /*********************************************************
@@ -100,143 +113,129 @@ CacheAssocTM::CacheAssocTM(int32_t s, int32_t a, int32_t b, int32_t u)
         ,sets((s/b)/a)
         ,maskSets(sets-1)
         ,numLines(s/b)
+        ,nReaderWords(PidMask::getNumWords())
 {
     I(numLines>0);
+    if(assoc > sizeof(WayMask) * 8) {
+        fail("CacheAssocTM supports up to %lu ways (%u)\n", sizeof(WayMask) * 8, assoc);
+    }
 
-    mem     = new TMLine [numLines + 1];
-    content = new TMLine* [numLines + 1];
+    mem      = new TMLine [numLines];
+    tags     = new VAddr [numLines];
+    flags    = new uint8_t [numLines];
+    readers  = new uint64_t [numLines * nReaderWords];
+    lruStamp = new uint64_t [numLines];
 
     for(uint32_t i = 0; i < numLines; i++) {
-        mem[i].initialize(this);
-        mem[i].invalidate();
-        content[i] = &mem[i];
+        mem[i].bind(&tags[i], &flags[i], &readers[i * nReaderWords]);
+        // Way 0 is the MRU line of the set
+        lruStamp[i] = assoc - 1 - (i & maskAssoc);
     }
+    lruClock = assoc;
 }
 
-///
-// Look up an cache line and return a pointer to that line, or NULL if not found
-TMLine *CacheAssocTM::lookupLine(VAddr addr)
+CacheAssocTM::CacheAssocTM(int32_t s, int32_t a, int32_t b, int32_t u, TMLineDirectory* dir, int32_t id)
+        : CacheAssocTM(s, a, b, u)
 {
-    VAddr tag = this->calcTag(addr);
-    TMLine **theSet = &content[this->calcIndex4Tag(tag)];
-
-    if(tag == 0) {
-        fail("Cannot lookup null: 0x%lx\n", addr);
+    I(dir);
+    I(id >= 0 && (size_t)id < PidMask::getNumWords() * 64);
+    for(uint32_t i = 0; i < numLines; i++) {
+        mem[i].attach(dir, id);
     }
+}
 
-    // Check most typical case
-    if ((*theSet)->getTag() == tag) {
-        return *theSet;
+///
+// Mask of the ways of the set at index with the given tag
+CacheAssocTM::WayMask CacheAssocTM::matchTag(uint32_t index, VAddr tag) const
+{
+    const VAddr *setTags = &tags[index];
+    WayMask ways = 0;
+    for(uint32_t w = 0; w < assoc; w++) {
+        ways |= ((WayMask)(setTags[w] == tag)) << w;
     }
+    return ways;
+}
 
-    TMLine **lineHit=0;
-    TMLine **setEnd = theSet + assoc;
-
-    // For sure that position 0 is not (short-cut)
-    {
-        TMLine **l = theSet + 1;
-        while(l < setEnd) {
-            if ((*l)->getTag() == tag) {
-                lineHit = l;
-                break;
+///
+// Mask of the ways of the set at index that satisfy comp
+CacheAssocTM::WayMask CacheAssocTM::matchLines(uint32_t index, const LineComparator& comp) const
+{
+    const uint8_t *setFlags = &flags[index];
+    WayMask ways = 0;
+    for(uint32_t w = 0; w < assoc; w++) {
+        ways |= ((WayMask)comp.testFlags(setFlags[w])) << w;
+    }
+    if(comp.pidTest != LineComparator::NoPidTest) {
+        for(WayMask m = ways; m; m &= m - 1) {
+            uint32_t w = __builtin_ctzll(m);
+            if(!comp.testPid(mem[index + w])) {
+                ways &= ~(((WayMask)1) << w);
             }
-            l++;
         }
     }
+    return ways;
+}
 
-    if (lineHit == 0)
-        return 0;
-
-    // No matter what is the policy, move lineHit to the *theSet. This
-    // increases locality
-    moveToMRU(theSet, lineHit);
-
-    return *theSet;
+///
+// Least recently used line among ways (not empty) of the set at index
+uint32_t CacheAssocTM::findOldestLine(uint32_t index, WayMask ways) const
+{
+    I(ways);
+    uint32_t oldest = index + __builtin_ctzll(ways);
+    for(WayMask m = ways & (ways - 1); m; m &= m - 1) {
+        uint32_t lineId = index + __builtin_ctzll(m);
+        if(lruStamp[lineId] < lruStamp[oldest]) {
+            oldest = lineId;
+        }
+    }
+    return oldest;
 }
 
 ///
-// Look up an cache line and return a pointer to that line, or NULL if not found
-TMLine *CacheAssocTM::findLine(VAddr addr)
+// Look up an cache line and return a pointer to that line, or NULL if not
+// found. A hit becomes the MRU line of its set.
+TMLine *CacheAssocTM::lookupLine(VAddr addr)
 {
     VAddr tag = this->calcTag(addr);
-    TMLine **theSet = &content[this->calcIndex4Tag(tag)];
-
     if(tag == 0) {
-        fail("Cannot find null: 0x%lx\n", addr);
-    }
-
-    // Check most typical case
-    if ((*theSet)->getTag() == tag) {
-        return *theSet;
+        fail("Cannot lookup null: 0x%lx\n", addr);
     }
 
-    TMLine **lineHit=0;
-    TMLine **setEnd = theSet + assoc;
-
-    // For sure that position 0 is not (short-cut)
-    {
-        TMLine **l = theSet + 1;
-        while(l < setEnd) {
-            if ((*l)->getTag() == tag) {
-                lineHit = l;
-                break;
-            }
-            l++;
-        }
+    uint32_t index = this->calcIndex4Tag(tag);
+    WayMask ways = matchTag(index, tag);
+    if(ways == 0) {
+        return 0;
     }
 
-    if (lineHit == 0)
-        return 0;
-    else
-        return *lineHit;
+    uint32_t lineId = index + __builtin_ctzll(ways);
+    moveToMRU(lineId);
+    return &mem[lineId];
 }
 
 ///
-// Move theTMLine to the MRU position in theSet
-void
-CacheAssocTM::moveToMRU(TMLine** theSet, TMLine** theTMLine)
+// Look up an cache line and return a pointer to that line, or NULL if not
+// found. The LRU order does not change.
+TMLine *CacheAssocTM::findLine(VAddr addr)
 {
-    TMLine *tmp = *theTMLine;
-    {
-        TMLine **l = theTMLine;
-        while(l > theSet) {
-            TMLine **prev = l - 1;
-            *l = *prev;;
-            l = prev;
-        }
-        *theSet = tmp;
+    VAddr tag = this->calcTag(addr);
+    if(tag == 0) {
+        fail("Cannot find null: 0x%lx\n", addr);
     }
-}
 
-///
-// Search through the set and find the oldest line satisfying comp
-TMLine
-**CacheAssocTM::findOldestLine(TMLine **theSet, const LineComparator& comp)
-{
-    TMLine **lineFree = 0;
-    TMLine **setEnd = theSet + assoc;
-
-    {
-        TMLine **l = setEnd -1;
-        while(l >= theSet) {
-            if (comp(*l)) {
-                lineFree = l;
-                break;
-            }
-            l--;
-        }
+    uint32_t index = this->calcIndex4Tag(tag);
+    WayMask ways = matchTag(index, tag);
+    if(ways == 0) {
+        return 0;
     }
-
-    return lineFree;
+    return &mem[index + __builtin_ctzll(ways)];
 }
 
 TMLine
 *CacheAssocTM::findLine2Replace(VAddr addr)
 {
     VAddr tag    = this->calcTag(addr);
-    TMLine **theSet = &content[this->calcIndex4Tag(tag)];
 
-    TMLine *replaced = findLine2Replace(theSet);
+    TMLine *replaced = findLine2Replace(this->calcIndex4Tag(tag));
     if(replaced == NULL) {
         fail("Replacing line is NULL!\n");
     }
@@ -249,29 +248,21 @@ TMLine
     return replaced;
 }
 
+///
+// Oldest invalid line of the set, or else the LRU line. It becomes the MRU
+// line of the set.
 TMLine
-*CacheAssocTM::findLine2Replace(TMLine** theSet)
+*CacheAssocTM::findLine2Replace(uint32_t index)
 {
-    TMLine **line2Replace=0;
-    TMLine **setEnd = theSet + assoc;
-
-    // Find oldest invalid line
     LineInvalidComparator invalCmp;
-    line2Replace = findOldestLine(theSet, invalCmp);
-
-    if(line2Replace == nullptr) {
-        // Or give up and return the oldest line
-        line2Replace = setEnd-1;
+    WayMask ways = matchLines(index, invalCmp);
+    if(ways == 0) {
+        ways = ~((WayMask)0) >> (sizeof(WayMask) * 8 - assoc);
     }
 
-    // No matter what is the policy, move line2Replace to the *theSet. This
-    // increases locality
-    if (line2Replace == theSet) {
-        return *line2Replace; // Hit in the first position
-    } else {
-        moveToMRU(theSet, line2Replace);
-        return *theSet;
-    }
+    uint32_t lineId = findOldestLine(index, ways);
+    moveToMRU(lineId);
+    return &mem[lineId];
 }
 
 ///
@@ -279,42 +270,16 @@ TMLine
 size_t
 CacheAssocTM::countLines(VAddr addr, const LineComparator& comp) const
 {
-    VAddr tag    = this->calcTag(addr);
-    TMLine **theSet = &content[this->calcIndex4Tag(tag)];
-
-    return countLines(theSet, comp);
-}
-
-///
-// Search through the set and count lines that satisfy comp. Private version
-// that accepts theSet as the argument.
-size_t
-CacheAssocTM::countLines(TMLine **theSet, const LineComparator& comp) const
-{
-    TMLine **setEnd = theSet + assoc;
-
-    size_t count = 0;
-    {
-        TMLine **l = theSet;
-        while(l < setEnd) {
-            if (comp(*l)) {
-                count++;
-            }
-            l++;
-        }
-    }
-    return count;
+    return __builtin_popcountll(matchLines(this->calcIndex4Addr(addr), comp));
 }
 
 ///
-// Collect all transactional lines in the core.
+// Collect all the lines in the cache that satisfy comp, with a linear scan of
+// the state array.
 void CacheAssocTM::collectLines(std::vector<TMLine*>& lines, const LineComparator& comp) {
     for(uint32_t i = 0; i < numLines; i++) {
-        TMLine* line = content[i];
-        if (comp(line)) {
-            lines.push_back(line);
+        if(comp.testFlags(flags[i]) && comp.testPid(mem[i])) {
+            lines.push_back(&mem[i]);
         }
     }
 }
-
-
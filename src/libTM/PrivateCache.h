@@ -3,9 +3,11 @@
 
 #include <set>
 #include "Snippets.h"
+#include "estl.h"
 #include "libemul/InstDesc.h"
 #include "libemul/Addressing.h"
 #include "CacheCore.h"
+#include "RWSetManager.h"
 
 enum EvictCause {
     NoEvict = 0,
@@ -13,105 +15,178 @@ enum EvictCause {
     EvictSetConflict,
 };
 
-class TMLine : public StateGeneric<> {
+///
+// Functional directory shared by the private caches of a TM manager. For each
+// valid line (by tag) it keeps the mask of cache ids that hold it, so that
+// snoops only visit the actual holders instead of every cache.
+class TMLineDirectory {
+public:
+    TMLineDirectory(int32_t lineSize): log2LineSize(log2i(lineSize)) {}
+
+    void addHolder(VAddr tag, int32_t cacheId) {
+        holders[tag].insert(cacheId);
+    }
+    void removeHolder(VAddr tag, int32_t cacheId);
+    // Return the ids of the caches that hold the line of addr
+    PidMask getHolders(VAddr addr) const {
+        HASH_MAP<VAddr, PidMask>::const_iterator i_line = holders.find(addr >> log2LineSize);
+        if(i_line == holders.end()) {
+            return PidMask();
+        }
+        return i_line->second;
+    }
+private:
+    const uint32_t              log2LineSize;
+    HASH_MAP<VAddr, PidMask>    holders;
+};
+
+///
+// State bits of a TMLine. They are kept in an array of the cache, so that
+// the set searches are mask tests.
+enum TMLineFlags {
+    TMLINE_VALID            = 1,
+    TMLINE_TRANSACTIONAL    = 2,
+    TMLINE_DIRTY            = 4,
+};
+
+///
+// Handle of a line of CacheAssocTM. The tag, the state bits and the reader
+// mask are slots in the arrays of the cache (structure of arrays), the
+// handle keeps the fields that are not searched.
+class TMLine {
 private:
-    bool            dirty;
-    bool            transactional;
-    std::set<Pid_t> tmReaders;
+    VAddr           *tag;       // 0 if invalid
+    uint8_t         *flags;
+    uint64_t        *readers;   // PidMask::getNumWords() words
     Pid_t           tmWriter;
     VAddr           caddr;
+    TMLineDirectory *directory;
+    int32_t         cacheId;
     static const VAddr INVALID_CADDR = 0xDEADCADD;
 public:
-    TMLine() {
+    TMLine(): tag(nullptr), flags(nullptr), readers(nullptr), tmWriter(INVALID_PID),
+        caddr(INVALID_CADDR), directory(nullptr), cacheId(-1) {
+    }
+    void bind(VAddr *t, uint8_t *f, uint64_t *r) {
+        tag     = t;
+        flags   = f;
+        readers = r;
         invalidate();
     }
+    void attach(TMLineDirectory* dir, int32_t id) {
+        I(isValid() == false);
+        directory = dir;
+        cacheId = id;
+    }
+    VAddr getTag() const {
+        return *tag;
+    }
+    bool isValid() const {
+        return *flags & TMLINE_VALID;
+    }
     bool isReader(Pid_t p) const {
-        return tmReaders.find(p) != tmReaders.end();
+        return (readers[p >> 6] >> (p & 63)) & 1;
     }
     bool isWriter(Pid_t p) const {
         return tmWriter == p;
     }
     void addReader(Pid_t p);
-    const std::set<Pid_t>& getReaders() const {
-        return tmReaders;
+    PidMask getReaders() const {
+        PidMask r;
+        r.orWords(readers);
+        return r;
     }
     Pid_t getWriter() const {
         return tmWriter;
     }
-    void getAccessors(std::set<Pid_t>& accessors) const;
+    void getAccessors(PidMask& accessors) const;
     void validate(VAddr t, VAddr c);
     VAddr getCaddr() const {
         return caddr;
     }
     bool isDirty() const {
-        return dirty;
+        return *flags & TMLINE_DIRTY;
     }
     void makeDirty();
     void makeTransactionalDirty(Pid_t writer);
     void makeClean();
     bool isTransactional() const {
-        return transactional;
+        return *flags & TMLINE_TRANSACTIONAL;
     }
     void markTransactional() {
-        transactional = true;
+        *flags |= TMLINE_TRANSACTIONAL;
     }
     void clearTransactional(Pid_t p);
-    virtual void invalidate();
+    void invalidate();
 };
 
+///
+// Line predicate of the cache searches: the state bits in mask must be equal
+// to value (or differ, if negated). Optionally pid must also be a reader
+// (accessed by) or the writer of the line.
 struct LineComparator {
-    virtual bool operator()(TMLine* l) const = 0;
+    enum PidTest { NoPidTest, ReaderPidTest, WriterPidTest };
+
+    LineComparator(uint8_t m, uint8_t v, bool neg = false, PidTest t = NoPidTest, Pid_t p = INVALID_PID)
+        : mask(m), value(v), negate(neg), pidTest(t), pid(p) {}
+
+    bool testFlags(uint8_t f) const {
+        return ((f & mask) == value) != negate;
+    }
+    bool testPid(const TMLine& l) const {
+        return pidTest == NoPidTest
+            || (pidTest == ReaderPidTest && l.isReader(pid))
+            || (pidTest == WriterPidTest && l.isWriter(pid));
+    }
+
+    const uint8_t   mask;
+    const uint8_t   value;
+    const bool      negate;
+    const PidTest   pidTest;
+    const Pid_t     pid;
 };
 
 struct LineValidComparator: public LineComparator {
-    virtual bool operator()(TMLine* l) const { return l->isValid(); }
+    LineValidComparator(): LineComparator(TMLINE_VALID, TMLINE_VALID) {}
 };
 struct LineTMComparator: public LineComparator {
-    virtual bool operator()(TMLine* l) const {
-        return l->isValid() && l->isTransactional();
-    }
+    LineTMComparator(): LineComparator(TMLINE_VALID | TMLINE_TRANSACTIONAL, TMLINE_VALID | TMLINE_TRANSACTIONAL) {}
 };
 struct LineInvalidComparator: public LineComparator {
-    virtual bool operator()(TMLine* l) const { return l->isValid() == false; }
+    LineInvalidComparator(): LineComparator(TMLINE_VALID, 0) {}
 };
 struct LineInvalidOrNonTMOrCleanComparator: public LineComparator {
-    virtual bool operator()(TMLine* l) const {
-        return (l->isValid() == false) || (l->isTransactional() == false) || (l->isDirty() == false);
-    }
+    LineInvalidOrNonTMOrCleanComparator()
+        : LineComparator(TMLINE_VALID | TMLINE_TRANSACTIONAL | TMLINE_DIRTY, TMLINE_VALID | TMLINE_TRANSACTIONAL | TMLINE_DIRTY, true) {}
 };
 struct LineNonTMComparator: public LineComparator {
-    virtual bool operator()(TMLine* l) const {
-        return l->isTransactional() == false;
-    }
+    LineNonTMComparator(): LineComparator(TMLINE_TRANSACTIONAL, 0) {}
 };
 struct LineNonTMOrCleanComparator: public LineComparator {
-    virtual bool operator()(TMLine* l) const {
-        return (l->isTransactional() == false) || (l->isDirty() == false);
-    }
+    LineNonTMOrCleanComparator()
+        : LineComparator(TMLINE_TRANSACTIONAL | TMLINE_DIRTY, TMLINE_TRANSACTIONAL | TMLINE_DIRTY, true) {}
 };
 struct LineTMDirtyComparator: public LineComparator {
-    virtual bool operator()(TMLine* l) const {
-        return l->isValid() && l->isTransactional() && l->isDirty();
-    }
+    LineTMDirtyComparator()
+        : LineComparator(TMLINE_VALID | TMLINE_TRANSACTIONAL | TMLINE_DIRTY, TMLINE_VALID | TMLINE_TRANSACTIONAL | TMLINE_DIRTY) {}
 };
 struct LineTMWrittenByComparator: public LineComparator {
-    LineTMWrittenByComparator(Pid_t p): pid(p) {}
-    virtual bool operator()(TMLine* l) const {
-        return (l->isValid() && l->isTransactional() && l->isWriter(pid));
-    }
-private:
-    Pid_t pid;
+    LineTMWrittenByComparator(Pid_t p)
+        : LineComparator(TMLINE_VALID | TMLINE_TRANSACTIONAL, TMLINE_VALID | TMLINE_TRANSACTIONAL, false, WriterPidTest, p) {}
 };
+// The writer of a line is always one of its readers
 struct LineTMAccessedByComparator: public LineComparator {
-    LineTMAccessedByComparator(Pid_t p): pid(p) {}
-    virtual bool operator()(TMLine* l) const {
-        return (l->isValid() && l->isTransactional() && (l->isReader(pid) || l->isWriter(pid)));
-    }
-private:
-    Pid_t pid;
+    LineTMAccessedByComparator(Pid_t p)
+        : LineComparator(TMLINE_VALID | TMLINE_TRANSACTIONAL, TMLINE_VALID | TMLINE_TRANSACTIONAL, false, ReaderPidTest, p) {}
 };
 
 
+///
+// Set associative cache of TMLines with LRU replacement. The lines of a set
+// are contiguous in the tag, state and LRU arrays, so a set search builds a
+// mask of the matching ways with a loop over the set (no early exit, the
+// compiler vectorizes it) instead of chasing line pointers. The LRU order is
+// a use stamp per line, and lines never move.
 class CacheAssocTM {
     const uint32_t  size;
     const uint32_t  lineSize;
@@ -123,22 +198,35 @@ class CacheAssocTM {
     const uint32_t  sets;
     const uint32_t  maskSets;
     const uint32_t  numLines;
+    const size_t    nReaderWords;
 
 protected:
+    typedef uint64_t WayMask;
 
-    TMLine *mem;
-    TMLine **content;
-    void moveToMRU(TMLine** theSet, TMLine** theTMLine);
-    TMLine *findLine2Replace(TMLine** theSet);
+    TMLine   *mem;
+    VAddr    *tags;
+    uint8_t  *flags;
+    uint64_t *readers;
+    uint64_t *lruStamp;
+    uint64_t lruClock;
 
-    TMLine **findOldestLine(TMLine **theSet, const LineComparator& comp);
-    size_t countLines(TMLine **theSet, const LineComparator& comp) const;
+    void moveToMRU(uint32_t lineId) {
+        lruStamp[lineId] = ++lruClock;
+    }
+    WayMask matchTag(uint32_t index, VAddr tag) const;
+    WayMask matchLines(uint32_t index, const LineComparator& comp) const;
+    uint32_t findOldestLine(uint32_t index, WayMask ways) const;
+    TMLine *findLine2Replace(uint32_t index);
 
 public:
     CacheAssocTM(int32_t size, int32_t assoc, int32_t blksize, int32_t addrUnit);
+    CacheAssocTM(int32_t size, int32_t assoc, int32_t blksize, int32_t addrUnit, TMLineDirectory* dir, int32_t id);
     virtual ~CacheAssocTM() {
-        delete [] content;
         delete [] mem;
+        delete [] tags;
+        delete [] flags;
+        delete [] readers;
+        delete [] lruStamp;
     }
 
     TMLine *findLine2Replace(VAddr addr);
@@ -1,68 +1,307 @@
 #include <cmath>
 #include <algorithm>
 #include <iostream>
+#include "libemul/EmulInit.h"
 #include "RWSetManager.h"
 
 using namespace std;
 
+size_t PidMask::nWords = PidMask::MaxWords;
+
+const VAddr  RWSetManager::InvalidCaddr;
+
+RWSetManager::RWSetManager():
+        nWords(PidMask::MaxWords),
+        tableBits(10),
+        tableMask((1 << 10) - 1),
+        nLines(0),
+        subBlockShift(-1),
+        subBlockLineMask(0),
+        threadsPerCache(1),
+        accessCaddr(InvalidCaddr) {
+}
+
 void RWSetManager::initialize(size_t nThreads) {
+    if(nThreads > PidMask::MaxPids) {
+        fail("RWSetManager supports up to %d threads (%lu)", PidMask::MaxPids, nThreads);
+    }
+    PidMask::setNumPids(nThreads);
+    nWords = PidMask::getNumWords();
+
+    nLines = 0;
+    lineCaddr.assign(tableMask + 1, InvalidCaddr);
+    lineReaders.assign((tableMask + 1) * nWords, 0);
+    lineWriters.assign((tableMask + 1) * nWords, 0);
+
     linesRead.resize(nThreads);
     linesWritten.resize(nThreads);
+    droppedReads.resize(nThreads);
+}
+
+///
+// Detect conflicts per granularity bytes instead of per line. Each group of
+// threadsPerCache consecutive pids shares a private cache.
+void RWSetManager::setSubBlocks(int lineSize, int granularity, size_t threadsPerCache) {
+    if(granularity >= lineSize) {
+        subBlockShift = -1;
+        return;
+    }
+    if(granularity <= 0 || (granularity & (granularity - 1)) || lineSize / granularity > 64) {
+        fail("conflictGranularity %d must be a power of two and split a %d byte line in up to 64 sub-blocks\n",
+             granularity, lineSize);
+    }
+    subBlockShift    = log2i(granularity);
+    subBlockLineMask = lineSize - 1;
+    this->threadsPerCache = threadsPerCache;
+    subBlocks.resize(linesRead.size());
+}
+
+///
+// Slot that holds caddr, or the empty slot where it would be inserted
+size_t RWSetManager::findSlot(VAddr caddr) const {
+    size_t slot = hashSlot(caddr);
+    while(lineCaddr[slot] != caddr && lineCaddr[slot] != InvalidCaddr) {
+        slot = (slot + 1) & tableMask;
+    }
+    return slot;
+}
+
+size_t RWSetManager::addLine(VAddr caddr) {
+    size_t slot = findSlot(caddr);
+    if(lineCaddr[slot] == caddr) {
+        return slot;
+    }
+
+    // Keep the load factor under 1/2
+    if(2 * (nLines + 1) > tableMask + 1) {
+        grow();
+        slot = findSlot(caddr);
+    }
+    lineCaddr[slot] = caddr;
+    nLines++;
+    return slot;
+}
+
+void RWSetManager::grow() {
+    vector<VAddr>       oldCaddr;
+    vector<uint64_t>    oldReaders;
+    vector<uint64_t>    oldWriters;
+    oldCaddr.swap(lineCaddr);
+    oldReaders.swap(lineReaders);
+    oldWriters.swap(lineWriters);
+
+    tableBits++;
+    tableMask = (tableMask << 1) | 1;
+    lineCaddr.assign(tableMask + 1, InvalidCaddr);
+    lineReaders.assign((tableMask + 1) * nWords, 0);
+    lineWriters.assign((tableMask + 1) * nWords, 0);
+
+    for(size_t i = 0; i < oldCaddr.size(); i++) {
+        if(oldCaddr[i] == InvalidCaddr) {
+            continue;
+        }
+        size_t slot = findSlot(oldCaddr[i]);
+        lineCaddr[slot] = oldCaddr[i];
+        for(size_t w = 0; w < nWords; w++) {
+            lineReaders[slot * nWords + w] = oldReaders[i * nWords + w];
+            lineWriters[slot * nWords + w] = oldWriters[i * nWords + w];
+        }
+    }
+}
+
+void RWSetManager::moveSlot(size_t from, size_t to) {
+    lineCaddr[to] = lineCaddr[from];
+    for(size_t w = 0; w < nWords; w++) {
+        lineReaders[to * nWords + w] = lineReaders[from * nWords + w];
+        lineWriters[to * nWords + w] = lineWriters[from * nWords + w];
+    }
+}
+
+///
+// Remove the line in slot, shifting back the lines after it in the probe
+// sequence (no tombstones)
+void RWSetManager::eraseSlot(size_t slot) {
+    size_t next = slot;
+    while(true) {
+        next = (next + 1) & tableMask;
+        if(lineCaddr[next] == InvalidCaddr) {
+            break;
+        }
+        size_t home = hashSlot(lineCaddr[next]);
+        bool stays = (slot <= next) ? (slot < home && home <= next) : (slot < home || home <= next);
+        if(!stays) {
+            moveSlot(next, slot);
+            slot = next;
+        }
+    }
+    lineCaddr[slot] = InvalidCaddr;
+    for(size_t w = 0; w < nWords; w++) {
+        lineReaders[slot * nWords + w] = 0;
+        lineWriters[slot * nWords + w] = 0;
+    }
+    nLines--;
 }
-void RWSetManager::read(Pid_t pid, VAddr caddr) {
-    readers[caddr].insert(pid);
-    linesRead.at(pid).insert(caddr);
+
+bool RWSetManager::isSlotEmpty(size_t slot) const {
+    for(size_t w = 0; w < nWords; w++) {
+        if(lineReaders[slot * nWords + w] || lineWriters[slot * nWords + w]) {
+            return false;
+        }
+    }
+    return true;
 }
-void RWSetManager::write(Pid_t pid, VAddr caddr) {
-    writers[caddr].insert(pid);
-    linesWritten.at(pid).insert(caddr);
+
+void RWSetManager::read(Pid_t pid, VAddr caddr, uint64_t subMask) {
+    if(subBlockShift >= 0) {
+        subBlocks[pid][caddr].read |= subMask;
+    }
+    size_t slot = addLine(caddr);
+    if(!testBit(lineReaders, slot, pid)) {
+        lineReaders[slot * nWords + (pid >> 6)] |= ((uint64_t)1) << (pid & 63);
+        // A dropped line read again is already in linesRead
+        if(droppedReads[pid].empty() || droppedReads[pid].erase(caddr) == 0) {
+            linesRead.at(pid).push_back(caddr);
+        }
+    }
+}
+void RWSetManager::write(Pid_t pid, VAddr caddr, uint64_t subMask) {
+    if(subBlockShift >= 0) {
+        subBlocks[pid][caddr].write |= subMask;
+    }
+    size_t slot = addLine(caddr);
+    if(!testBit(lineWriters, slot, pid)) {
+        lineWriters[slot * nWords + (pid >> 6)] |= ((uint64_t)1) << (pid & 63);
+        linesWritten.at(pid).push_back(caddr);
+    }
+}
+void RWSetManager::dropRead(Pid_t pid, VAddr caddr) {
+    size_t slot = findSlot(caddr);
+    if(lineCaddr[slot] != caddr || !testBit(lineReaders, slot, pid)) {
+        return;
+    }
+    lineReaders[slot * nWords + (pid >> 6)] &= ~(((uint64_t)1) << (pid & 63));
+    if(isSlotEmpty(slot)) {
+        eraseSlot(slot);
+    }
+    droppedReads.at(pid).insert(caddr);
 }
 void RWSetManager::clear(Pid_t pid) {
+    uint64_t pidMask = ~(((uint64_t)1) << (pid & 63));
+
     // First step through addresses I accessed and clear them from readers/writers
     for(VAddr caddr:  linesRead.at(pid)) {
-        auto i_line = readers.find(caddr);
-        i_line->second.erase(pid);
-        if(i_line->second.empty()) {
-            readers.erase(i_line);
+        size_t slot = findSlot(caddr);
+        if(lineCaddr[slot] != caddr) {
+            // Dropped, and no other thread has it
+            I(droppedReads[pid].count(caddr));
+            continue;
+        }
+        lineReaders[slot * nWords + (pid >> 6)] &= pidMask;
+        if(isSlotEmpty(slot)) {
+            eraseSlot(slot);
         }
     }
     for(VAddr caddr:  linesWritten.at(pid)) {
-        auto i_line = writers.find(caddr);
-        i_line->second.erase(pid);
-        if(i_line->second.empty()) {
-            writers.erase(i_line);
+        size_t slot = findSlot(caddr);
+        I(lineCaddr[slot] == caddr);
+        lineWriters[slot * nWords + (pid >> 6)] &= pidMask;
+        if(isSlotEmpty(slot)) {
+            eraseSlot(slot);
         }
     }
     // Then clear my own address set
     linesRead.at(pid).clear();
     linesWritten.at(pid).clear();
+    droppedReads.at(pid).clear();
+    if(subBlockShift >= 0) {
+        subBlocks[pid].clear();
+    }
+}
+
+bool RWSetManager::hadRead(Pid_t pid, VAddr caddr) const {
+    size_t slot = findSlot(caddr);
+    return lineCaddr[slot] == caddr && testBit(lineReaders, slot, pid);
+}
+bool RWSetManager::hadWrote(Pid_t pid, VAddr caddr) const {
+    size_t slot = findSlot(caddr);
+    return lineCaddr[slot] == caddr && testBit(lineWriters, slot, pid);
 }
 
-size_t RWSetManager::numReaders(VAddr caddr) const {
-    auto i_line = readers.find(caddr);
-    if(i_line == readers.end()) {
-        return 0;
-    } else {
-        return i_line->second.size();
+PidMask RWSetManager::getReaders(VAddr caddr) const {
+    PidMask r;
+    size_t slot = findSlot(caddr);
+    if(lineCaddr[slot] == caddr) {
+        r.orWords(&lineReaders[slot * nWords]);
     }
+    return r;
 }
-size_t RWSetManager::numWriters(VAddr caddr) const {
-    auto i_line = writers.find(caddr);
-    if(i_line == writers.end()) {
-        return 0;
-    } else {
-        return i_line->second.size();
+PidMask RWSetManager::getWriters(VAddr caddr) const {
+    PidMask w;
+    size_t slot = findSlot(caddr);
+    if(lineCaddr[slot] == caddr) {
+        w.orWords(&lineWriters[slot * nWords]);
+        if(caddr == accessCaddr) {
+            w -= accessSkippedWriters;
+        }
+    }
+    return w;
+}
+PidMask RWSetManager::getSharers(VAddr caddr) const {
+    PidMask s;
+    size_t slot = findSlot(caddr);
+    if(lineCaddr[slot] == caddr) {
+        s.orWords(&lineReaders[slot * nWords]);
+        s.orWords(&lineWriters[slot * nWords]);
+        if(caddr == accessCaddr) {
+            s -= accessSkippedSharers;
+        }
     }
+    return s;
 }
-void RWSetManager::getReaders(VAddr caddr, std::set<Pid_t>& r) const {
-    auto i_line = readers.find(caddr);
-    if(i_line != readers.end()) {
-        r.insert(i_line->second.begin(), i_line->second.end());
+
+uint64_t RWSetManager::getWriteMask(Pid_t pid, VAddr caddr) const {
+    if(subBlockShift < 0) {
+        return AllSubBlocks;
     }
+    HASH_MAP<VAddr, SubBlockMasks>::const_iterator i_line = subBlocks[pid].find(caddr);
+    return i_line == subBlocks[pid].end() ? 0 : i_line->second.write;
 }
-void RWSetManager::getWriters(VAddr caddr, std::set<Pid_t>& w) const {
-    auto i_line = writers.find(caddr);
-    if(i_line != writers.end()) {
-        w.insert(i_line->second.begin(), i_line->second.end());
+
+///
+// Start an access of pid to the sub-blocks subMask of caddr. The writers of
+// the line that did not write those sub-blocks, and the sharers that did not
+// touch them, are left out of getWriters and getSharers until endAccess.
+// getSubBlockSharers returns the ones left out of getSharers for a write, and
+// out of getWriters for a read.
+void RWSetManager::beginAccess(Pid_t pid, VAddr caddr, uint64_t subMask, bool isWrite) {
+    accessCaddr = caddr;
+    accessSkippedWriters.clear();
+    accessSkippedSharers.clear();
+    accessSkipped.clear();
+    size_t slot = findSlot(caddr);
+    if(subBlockShift < 0 || lineCaddr[slot] != caddr) {
+        return;
+    }
+
+    PidMask sharers;
+    sharers.orWords(&lineReaders[slot * nWords]);
+    sharers.orWords(&lineWriters[slot * nWords]);
+    for(Pid_t other: sharers) {
+        // The private cache of pid keeps one writer per line
+        if(other / threadsPerCache == pid / threadsPerCache) {
+            continue;
+        }
+        HASH_MAP<VAddr, SubBlockMasks>::const_iterator i_line = subBlocks[other].find(caddr);
+        SubBlockMasks touched;
+        if(i_line != subBlocks[other].end()) {
+            touched = i_line->second;
+        }
+        if(testBit(lineWriters, slot, other) && (touched.write & subMask) == 0) {
+            accessSkippedWriters.insert(other);
+        }
+        if(((touched.read | touched.write) & subMask) == 0) {
+            accessSkippedSharers.insert(other);
+        }
     }
+    accessSkipped = isWrite ? accessSkippedSharers : accessSkippedWriters;
 }
@@ -2,41 +2,234 @@
 #define HTM_RWSET_MANAGER
 
 #include <vector>
-#include <map>
-#include <set>
+#include <string.h>
+#include "nanassert.h"
 #include "Snippets.h"
+#include "estl.h"
 #include "libemul/Addressing.h"
 
+///
+// Set of pids stored as a bitmask. The width (number of 64-bit words used) is
+// the same for all the masks and it is set once with setNumPids.
+class PidMask {
+public:
+    enum { MaxPids = 512, MaxWords = MaxPids / 64 };
+
+    class const_iterator {
+    public:
+        const_iterator(const PidMask *m, Pid_t p): mask(m), pid(p) {}
+        Pid_t operator*() const { return pid; }
+        const_iterator& operator++() {
+            pid = mask->next(pid + 1);
+            return *this;
+        }
+        bool operator!=(const const_iterator& other) const { return pid != other.pid; }
+        bool operator==(const const_iterator& other) const { return pid == other.pid; }
+    private:
+        const PidMask   *mask;
+        Pid_t           pid;
+    };
+
+    PidMask() { clear(); }
+
+    static void setNumPids(size_t nPids) {
+        I(nPids <= MaxPids);
+        nWords = (nPids + 63) / 64;
+        if(nWords == 0) {
+            nWords = 1;
+        }
+    }
+    static size_t getNumWords() { return nWords; }
+
+    void clear() { memset(bits, 0, sizeof(bits)); }
+    void insert(Pid_t pid) {
+        I(pid >= 0 && (size_t)pid < nWords * 64);
+        bits[pid >> 6] |= ((uint64_t)1) << (pid & 63);
+    }
+    void erase(Pid_t pid) {
+        I(pid >= 0 && (size_t)pid < nWords * 64);
+        bits[pid >> 6] &= ~(((uint64_t)1) << (pid & 63));
+    }
+    size_t count(Pid_t pid) const {
+        return (bits[pid >> 6] >> (pid & 63)) & 1;
+    }
+    bool empty() const {
+        for(size_t w = 0; w < nWords; w++) {
+            if(bits[w]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    size_t size() const {
+        size_t n = 0;
+        for(size_t w = 0; w < nWords; w++) {
+            n += __builtin_popcountll(bits[w]);
+        }
+        return n;
+    }
+    PidMask& operator|=(const PidMask& other) {
+        for(size_t w = 0; w < nWords; w++) {
+            bits[w] |= other.bits[w];
+        }
+        return *this;
+    }
+    PidMask& operator-=(const PidMask& other) {
+        for(size_t w = 0; w < nWords; w++) {
+            bits[w] &= ~other.bits[w];
+        }
+        return *this;
+    }
+
+    // Raw access for packed storage (getNumWords() words)
+    const uint64_t *getWords() const { return bits; }
+    void orWords(const uint64_t *words) {
+        for(size_t w = 0; w < nWords; w++) {
+            bits[w] |= words[w];
+        }
+    }
+
+    // First pid in the set that is >= from (endPid() if none)
+    Pid_t next(Pid_t from) const {
+        size_t w = from >> 6;
+        if(w >= nWords) {
+            return endPid();
+        }
+        uint64_t word = bits[w] & ((~(uint64_t)0) << (from & 63));
+        while(word == 0) {
+            if(++w >= nWords) {
+                return endPid();
+            }
+            word = bits[w];
+        }
+        return (Pid_t)(w * 64 + __builtin_ctzll(word));
+    }
+
+    const_iterator begin() const { return const_iterator(this, next(0)); }
+    const_iterator end() const   { return const_iterator(this, endPid()); }
+private:
+    static Pid_t endPid() { return (Pid_t)(nWords * 64); }
+
+    static size_t nWords;
+    uint64_t bits[MaxWords];
+};
+
 ///
 // Class that maintains the read/write set of the entire system.
+// Lines are kept in an open-addressing hash table (linear probing) keyed by
+// cache line, with a reader and a writer pid mask per line. Each thread keeps
+// the list of lines it read/wrote to clear them at commit/abort.
+//
+// With sub-block conflict detection (setSubBlocks) each thread also keeps a
+// mask of the sub-blocks it read/wrote of each line. beginAccess works out
+// once which threads of the accessed line did not touch the sub-blocks of the
+// access; until endAccess getWriters and getSharers leave them out, and
+// getSubBlockSharers returns them. Threads that share a private cache (SMT
+// peers) are never left out: the cache keeps one writer per line.
 class RWSetManager {
 public:
-    RWSetManager() {}
+    RWSetManager();
+
+    static const uint64_t AllSubBlocks = ~((uint64_t)0);
 
     void initialize(size_t nThreads);
-    void read(Pid_t pid, VAddr caddr);
-    void write(Pid_t pid, VAddr caddr);
+    void setSubBlocks(int lineSize, int granularity, size_t threadsPerCache);
+    void read(Pid_t pid, VAddr caddr, uint64_t subMask = AllSubBlocks);
+    void write(Pid_t pid, VAddr caddr, uint64_t subMask = AllSubBlocks);
+    // pid stops being a reader of caddr (it is tracked somewhere else, e.g.
+    // an overflow signature) but the line still counts in getNumReads
+    void dropRead(Pid_t pid, VAddr caddr);
     void clear(Pid_t pid);
 
+    // Sub-block conflict detection
+    bool     hasSubBlocks() const { return subBlockShift >= 0; }
+    // Sub-blocks touched by the size bytes at raddr (up to the end of its line)
+    uint64_t getSubBlockMask(VAddr raddr, size_t size) const {
+        if(subBlockShift < 0) {
+            return AllSubBlocks;
+        }
+        VAddr offs  = raddr & subBlockLineMask;
+        VAddr last  = offs + (size ? size - 1 : 0);
+        if(last > subBlockLineMask) {
+            last = subBlockLineMask;
+        }
+        int   first = offs >> subBlockShift;
+        int   nSubs = (last >> subBlockShift) - first + 1;
+        uint64_t mask = nSubs >= 64 ? AllSubBlocks : (((uint64_t)1) << nSubs) - 1;
+        return mask << first;
+    }
+    uint64_t getWriteMask(Pid_t pid, VAddr caddr) const;
+    void    beginAccess(Pid_t pid, VAddr caddr, uint64_t subMask, bool isWrite);
+    // Returns the threads that only conflicted at line granularity
+    PidMask endAccess() {
+        accessCaddr = InvalidCaddr;
+        return accessSkipped;
+    }
+    PidMask getSubBlockSharers(VAddr caddr) const {
+        return caddr == accessCaddr ? accessSkipped : PidMask();
+    }
+
     // Various getters/setters
     size_t getNumReads(Pid_t pid)   const { return linesRead.at(pid).size(); }
     size_t getNumWrites(Pid_t pid)  const { return linesWritten.at(pid).size(); }
-    size_t numReaders(VAddr caddr) const;
-    size_t numWriters(VAddr caddr) const;
-    bool hadRead(Pid_t pid, VAddr caddr) const {
-        return linesRead.at(pid).find(caddr) != linesRead.at(pid).end();
-    }
-    bool hadWrote(Pid_t pid, VAddr caddr) const {
-        return linesWritten.at(pid).find(caddr) != linesWritten.at(pid).end();
-    }
+    // Lines read/written by pid, in the order of the first access
+    const std::vector<VAddr>& getLinesRead(Pid_t pid)    const { return linesRead.at(pid); }
+    const std::vector<VAddr>& getLinesWritten(Pid_t pid) const { return linesWritten.at(pid); }
+    size_t numReaders(VAddr caddr) const { return getReaders(caddr).size(); }
+    size_t numWriters(VAddr caddr) const { return getWriters(caddr).size(); }
+    bool hadRead(Pid_t pid, VAddr caddr) const;
+    bool hadWrote(Pid_t pid, VAddr caddr) const;
     // Return set of threads that read/wrote to given caddr
-    void getReaders(VAddr caddr, std::set<Pid_t>& r) const;
-    void getWriters(VAddr caddr, std::set<Pid_t>& w) const;
+    PidMask getReaders(VAddr caddr) const;
+    PidMask getWriters(VAddr caddr) const;
+    PidMask getSharers(VAddr caddr) const;
 private:
-    std::vector<std::set<VAddr> >       linesRead;
-    std::vector<std::set<VAddr> >       linesWritten;
-    std::map<VAddr, std::set<Pid_t> >   writers;
-    std::map<VAddr, std::set<Pid_t> >   readers;
+    static const VAddr InvalidCaddr = ~((VAddr)0);
+
+    size_t hashSlot(VAddr caddr) const {
+        return (size_t)((caddr * 0x9E3779B97F4A7C15ULL) >> (64 - tableBits)) & tableMask;
+    }
+    size_t findSlot(VAddr caddr) const;
+    size_t addLine(VAddr caddr);
+    void   eraseSlot(size_t slot);
+    void   moveSlot(size_t from, size_t to);
+    void   grow();
+
+    bool testBit(const std::vector<uint64_t>& masks, size_t slot, Pid_t pid) const {
+        return (masks[slot * nWords + (pid >> 6)] >> (pid & 63)) & 1;
+    }
+    bool isSlotEmpty(size_t slot) const;
+
+    struct SubBlockMasks {
+        SubBlockMasks(): read(0), write(0) {}
+        uint64_t    read;
+        uint64_t    write;
+    };
+
+    size_t      nWords;
+    size_t      tableBits;
+    size_t      tableMask;
+    size_t      nLines;
+
+    std::vector<VAddr>      lineCaddr;
+    std::vector<uint64_t>   lineReaders;
+    std::vector<uint64_t>   lineWriters;
+
+    std::vector<std::vector<VAddr> >    linesRead;
+    std::vector<std::vector<VAddr> >    linesWritten;
+    // Lines in linesRead that dropRead took out of the table
+    std::vector<HASH_SET<VAddr> >       droppedReads;
+
+    // Sub-block state, subBlockShift is -1 if detection is per line
+    int         subBlockShift;
+    VAddr       subBlockLineMask;
+    size_t      threadsPerCache;
+    std::vector<HASH_MAP<VAddr, SubBlockMasks> >  subBlocks;
+    // Access in progress (beginAccess) and the threads left out of it
+    VAddr       accessCaddr;
+    PidMask     accessSkippedWriters;
+    PidMask     accessSkippedSharers;
+    PidMask     accessSkipped;
 };
 
 #endif
@@ -0,0 +1,167 @@
+#include "nanassert.h"
+#include "SescConf.h"
+#include "libemul/EmulInit.h"
+#include "libll/ThreadContext.h"
+#include "SigTMManager.h"
+
+using namespace std;
+
+///
+// Read the size and number of hash functions of the read or write signature
+// (readSigBits/readSigHashes or writeSigBits/writeSigHashes)
+static TMSigHash createSigHash(const char *set, int lineSize) {
+    char bitsName[32];
+    char hashesName[32];
+    sprintf(bitsName, "%sSigBits", set);
+    sprintf(hashesName, "%sSigHashes", set);
+
+    // Different H3 values for the read and the write signatures
+    TMSigHash hash = TMSigHash::create(bitsName, 2048, hashesName, 4, lineSize, set[0] == 'w');
+    MSG("SigTM %s signature: %lu bits, %d hashes", set, hash.getNumBits(), hash.getNumHashes());
+    return hash;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Signature-based HTM (SigTM-like eager conflict detection, requester wins)
+/////////////////////////////////////////////////////////////////////////////////////////
+SigTMManager::SigTMManager(const char tmStyle[], int32_t nCores, int32_t line):
+        HTMManager(tmStyle, nCores, line),
+        readHash(createSigHash("read", line)),
+        writeHash(createSigHash("write", line)),
+        sigConflicts("tm:sigConflicts"),
+        sigFalseConflicts("tm:sigFalseConflicts"),
+        readSigBitsSet("tm:readSigBitsSet"),
+        writeSigBitsSet("tm:writeSigBitsSet") {
+
+    // The exact read/write sets only classify false positives
+    sigExactSets = SescConf->checkBool("TransactionalMemory", "sigExactSets")
+            && SescConf->getBool("TransactionalMemory", "sigExactSets");
+    trackRWSets = sigExactSets;
+    if(sigExactSets) {
+        MSG("SigTM keeps exact read/write sets for tm:sigFalseConflicts");
+    }
+
+    for(Pid_t pid = 0; pid < (Pid_t)nThreads; pid++) {
+        readSigs.push_back(TMSignature(&readHash));
+        writeSigs.push_back(TMSignature(&writeHash));
+    }
+}
+
+SigTMManager::~SigTMManager() {
+}
+
+///
+// Helper function that aborts the running transactions whose signatures
+// conflict with an access of pid: their write signature for a read, and any
+// of their signatures for a write. Only the owners of non-empty signatures
+// are tested. With sigExactSets, conflicts missing from the exact read/write
+// sets are false positives.
+void SigTMManager::abortConflicting(Pid_t pid, VAddr caddr, bool isWrite, bool isTM) {
+    if(sigOwners.empty()) {
+        return;
+    }
+    TMSigKey readKey;
+    TMSigKey writeKey;
+    writeHash.getKey(caddr, writeKey);
+    if(isWrite) {
+        readHash.getKey(caddr, readKey);
+    }
+
+    for(Pid_t other: sigOwners) {
+        if(other == pid || getTMState(other) != TMStateEngine::TM_RUNNING) {
+            continue;
+        }
+        if(!writeSigs[other].mayContain(writeKey)
+                && !(isWrite && readSigs[other].mayContain(readKey))) {
+            continue;
+        }
+        sigConflicts.inc();
+
+        TMAbortType_e abortType = isTM ? TM_ATYPE_DEFAULT : TM_ATYPE_NONTM;
+        if(sigExactSets && !rwSetManager.hadWrote(other, caddr)
+                && !(isWrite && rwSetManager.hadRead(other, caddr))) {
+            sigFalseConflicts.inc();
+            abortType = TM_ATYPE_FALSEPOS;
+        }
+        markTransAborted(other, pid, caddr, abortType);
+    }
+}
+
+///
+// Helper function that empties the signatures of pid
+void SigTMManager::clearSignatures(Pid_t pid) {
+    readSigs[pid].clear();
+    writeSigs[pid].clear();
+    sigOwners.erase(pid);
+}
+
+///
+// Do a transactional read.
+TMRWStatus SigTMManager::TMRead(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+    Pid_t pid   = context->getPid();
+    VAddr caddr = addrToCacheLine(raddr);
+
+    abortConflicting(pid, caddr, false, true);
+    p_opStatus->wasHit = false;
+
+    TMSigKey key;
+    readHash.getKey(caddr, key);
+    readSigs[pid].insert(key);
+    sigOwners.insert(pid);
+
+    return TMRW_SUCCESS;
+}
+
+///
+// Do a transactional write.
+TMRWStatus SigTMManager::TMWrite(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+    Pid_t pid   = context->getPid();
+    VAddr caddr = addrToCacheLine(raddr);
+
+    abortConflicting(pid, caddr, true, true);
+    p_opStatus->wasHit = false;
+
+    // Lines already in the signature are not counted again, so that the
+    // number of inserts approximates the write set size
+    TMSigKey key;
+    writeHash.getKey(caddr, key);
+    if(!writeSigs[pid].mayContain(key)) {
+        writeSigs[pid].insert(key);
+    }
+    sigOwners.insert(pid);
+
+    return TMRW_SUCCESS;
+}
+
+///
+// Do a non-transactional read, i.e. when a thread not inside a transaction.
+void SigTMManager::nonTMRead(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+    abortConflicting(context->getPid(), addrToCacheLine(raddr), false, false);
+    p_opStatus->wasHit = false;
+}
+
+///
+// Do a non-transactional write, i.e. when a thread not inside a transaction.
+void SigTMManager::nonTMWrite(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus) {
+    abortConflicting(context->getPid(), addrToCacheLine(raddr), true, false);
+    p_opStatus->wasHit = false;
+}
+
+TMBCStatus SigTMManager::myCommit(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus) {
+    Pid_t pid   = context->getPid();
+
+    TMBCStatus status = HTMManager::myCommit(inst, context, p_opStatus);
+    if(!trackRWSets) {
+        p_opStatus->tmLat = 4 + writeSigs[pid].getNumInserted();
+    }
+
+    readSigBitsSet.sample(readSigs[pid].getNumSetBits());
+    writeSigBitsSet.sample(writeSigs[pid].getNumSetBits());
+    clearSignatures(pid);
+
+    return status;
+}
+
+void SigTMManager::myStartAborting(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus) {
+    clearSignatures(context->getPid());
+}
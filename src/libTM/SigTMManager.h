@@ -0,0 +1,52 @@
+#ifndef SIGTM_MANAGER
+#define SIGTM_MANAGER
+
+#include <vector>
+#include "HTMManager.h"
+#include "TMSignature.h"
+
+///
+// Eager HTM that detects conflicts with per-thread read and write signatures
+// instead of tracking the lines in private caches. An access tests the
+// signatures of the other running transactions and the requester wins (the
+// conflicting transactions are aborted). Exact read/write sets are only kept
+// with sigExactSets, to report the aborts caused by signature aliasing as
+// TM_ATYPE_FALSEPOS. There is no cache model, so the memory hierarchy
+// provides all the latencies.
+class SigTMManager: public HTMManager {
+public:
+    SigTMManager(const char tmStyle[], int32_t nCores, int32_t line);
+    virtual ~SigTMManager();
+
+protected:
+    virtual TMRWStatus TMRead(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
+    virtual TMRWStatus TMWrite(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
+    virtual void       nonTMRead(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
+    virtual void       nonTMWrite(InstDesc* inst, const ThreadContext* context, VAddr raddr, InstContext* p_opStatus);
+    virtual void       myStartAborting(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus);
+    virtual TMBCStatus myCommit(InstDesc* inst, const ThreadContext* context, InstContext* p_opStatus);
+
+    // Helper functions
+    void abortConflicting(Pid_t pid, VAddr caddr, bool isWrite, bool isTM);
+    void clearSignatures(Pid_t pid);
+
+    // Configurable member variables
+    TMSigHash       readHash;
+    TMSigHash       writeHash;
+    bool            sigExactSets;
+
+    // Statistics
+    GStatsCntr      sigConflicts;
+    GStatsCntr      sigFalseConflicts;
+    // Bits set in the signatures of committed transactions
+    GStatsAvg       readSigBitsSet;
+    GStatsAvg       writeSigBitsSet;
+
+    // State member variables
+    std::vector<TMSignature>    readSigs;
+    std::vector<TMSignature>    writeSigs;
+    // Transactions with a non-empty signature
+    PidMask                     sigOwners;
+};
+
+#endif
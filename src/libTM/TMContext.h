@@ -40,10 +40,7 @@ private:
 
 template<class T>
 void TMContext::cacheAccess(VAddr addr, T oval, T* p_val) {
-    cache2.loadLine(context, addr);
-    T newval = cache2.load<T>(addr);
-
-    *p_val = newval;
+    *p_val = cache2.load<T>(context, addr, oval);
 }
 
 template<class T>
@@ -0,0 +1,97 @@
+#include <string.h>
+#include "nanassert.h"
+#include "SescConf.h"
+#include "libemul/EmulInit.h"
+#include "TMOverflow.h"
+
+using namespace std;
+
+TMOverflowSet::TMOverflowSet(size_t nThreads, int lineSize):
+        mode(Exact),
+        maxSize(4),
+        hash(NULL),
+        overflowLines("tm:overflowLines"),
+        sigConflicts("tm:overflowSigConflicts"),
+        lines(nThreads) {
+
+    if(SescConf->checkCharPtr("TransactionalMemory", "overflowMode")) {
+        const char *name = SescConf->getCharPtr("TransactionalMemory", "overflowMode");
+        if(strcasecmp(name, "Set") == 0) {
+            mode = Exact;
+        } else if(strcasecmp(name, "Signature") == 0) {
+            mode = Signature;
+        } else {
+            fail("Unknown overflowMode %s (Set or Signature)\n", name);
+        }
+    }
+
+    if(mode == Exact) {
+        if(SescConf->checkInt("TransactionalMemory","overflowSize")) {
+            maxSize = SescConf->getInt("TransactionalMemory","overflowSize");
+        } else {
+            MSG("Using default overflow size of %ld\n", maxSize);
+        }
+        return;
+    }
+
+    hash = new TMSigHash(TMSigHash::create("overflowSigBits", 1024, "overflowSigHashes", 4, lineSize, false));
+    MSG("Overflow read signature: %lu bits, %d hashes", hash->getNumBits(), hash->getNumHashes());
+    sigs.resize(nThreads, TMSignature(hash));
+}
+
+TMOverflowSet::~TMOverflowSet() {
+    delete hash;
+}
+
+bool TMOverflowSet::insert(Pid_t pid, VAddr caddr) {
+    if(mode == Signature) {
+        TMSigKey key;
+        hash->getKey(caddr, key);
+        sigs.at(pid).insert(key);
+        sigOwners.insert(pid);
+    } else if(lines.at(pid).size() < maxSize) {
+        lines[pid].insert(caddr);
+    } else {
+        return false;
+    }
+    overflowLines.inc();
+    return true;
+}
+
+void TMOverflowSet::remove(Pid_t pid, VAddr caddr) {
+    if(mode == Exact) {
+        lines.at(pid).erase(caddr);
+    }
+}
+
+bool TMOverflowSet::mayContain(Pid_t pid, VAddr caddr) const {
+    if(mode == Exact) {
+        return lines.at(pid).find(caddr) != lines[pid].end();
+    }
+    TMSigKey key;
+    hash->getKey(caddr, key);
+    return sigs.at(pid).mayContain(key);
+}
+
+void TMOverflowSet::clear(Pid_t pid) {
+    if(mode == Exact) {
+        lines.at(pid).clear();
+    } else {
+        sigs.at(pid).clear();
+        sigOwners.erase(pid);
+    }
+}
+
+void TMOverflowSet::getSigHits(Pid_t pid, VAddr caddr, PidMask& hits) {
+    if(mode == Exact || sigOwners.empty()) {
+        return;
+    }
+    TMSigKey key;
+    hash->getKey(caddr, key);
+    for(Pid_t other: sigOwners) {
+        if(other != pid && sigs[other].mayContain(key)) {
+            hits.insert(other);
+            sigConflicts.inc();
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef TM_OVERFLOW
+#define TM_OVERFLOW
+
+#include <set>
+#include <vector>
+#include "GStats.h"
+#include "RWSetManager.h"
+#include "TMSignature.h"
+
+///
+// Clean transactional lines evicted from the private caches of PleaseTM and
+// TSX (overflowMode):
+//   Set:       an exact set of at most overflowSize lines per thread. Evicting
+//              one more line is a capacity (TM_ATYPE_SETCONFLICT) abort.
+//   Signature: a read signature per thread (overflowSigBits/overflowSigHashes)
+//              that never fills up. The managers drop the evicted line from
+//              the exact read set (RWSetManager::dropRead), so the signature
+//              is where remote writes find the conflict, false positives
+//              included. Lines can not be taken out of it, so a line brought
+//              back into the cache stays in the signature until commit or
+//              abort.
+class TMOverflowSet {
+public:
+    enum Mode { Exact, Signature };
+
+    TMOverflowSet(size_t nThreads, int lineSize);
+    ~TMOverflowSet();
+
+    // Returns false if the line does not fit and the reader has to abort
+    bool insert(Pid_t pid, VAddr caddr);
+    // The line is back in the cache of pid
+    void remove(Pid_t pid, VAddr caddr);
+    bool mayContain(Pid_t pid, VAddr caddr) const;
+    void clear(Pid_t pid);
+
+    bool usesSignature() const { return mode == Signature; }
+    // Adds to hits the threads other than pid whose signature may contain
+    // caddr. Only the threads with a non-empty signature are looked at.
+    void getSigHits(Pid_t pid, VAddr caddr, PidMask& hits);
+private:
+    // Configurable member variables
+    Mode            mode;
+    size_t          maxSize;
+    TMSigHash       *hash;
+
+    // Statistics
+    GStatsCntr      overflowLines;
+    GStatsCntr      sigConflicts;
+
+    // State member variables
+    std::vector<std::set<VAddr> >   lines;
+    std::vector<TMSignature>        sigs;
+    PidMask                         sigOwners;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include "nanassert.h"
+#include "SescConf.h"
+#include "ReportGen.h"
+#include "libemul/EmulInit.h"
+#include "libll/ThreadContext.h"
+#include "TMProfiler.h"
+
+using namespace std;
+
+static const char *abortTypeNames[] = { "conflict", "user", "syscall", "capacity", "nonTM", "falsePos" };
+
+///
+// Factory function, reads the profiler options of the TransactionalMemory
+// section
+TMProfiler *TMProfiler::create(size_t nThreads) {
+    if(!SescConf->checkBool("TransactionalMemory", "abortProfiler")
+            || !SescConf->getBool("TransactionalMemory", "abortProfiler")) {
+        return NULL;
+    }
+    size_t nTop = 5;
+    if(SescConf->checkInt("TransactionalMemory", "abortProfilerTop")) {
+        nTop = SescConf->getInt("TransactionalMemory", "abortProfilerTop");
+    }
+    MSG("Profiling TM aborts per atomic block (top %lu)", nTop);
+    return new TMProfiler(nThreads, nTop);
+}
+
+TMProfiler::TMProfiler(size_t nThreads, size_t n):
+        nTop(n),
+        currentSite(nThreads, 0),
+        startedAt(nThreads, 0),
+        aborterSite(nThreads, 0),
+        abortLine(nThreads, 0) {
+}
+
+///
+// Function and offset of a site, looked up once per site
+string TMProfiler::symbolize(VAddr site, const ThreadContext* context) {
+    string func;
+    VAddr funcAddr;
+    if(context->getAddressSpace()->findFunc(site, func, funcAddr) == false || func.empty()) {
+        return string();
+    }
+    char offset[32];
+    sprintf(offset, "+0x%lx", (unsigned long)(site - funcAddr));
+    return func + offset;
+}
+
+///
+// globalClock does not advance in rabbit mode, so transactions that begin,
+// commit or abort while skipping are not profiled
+void TMProfiler::begin(Pid_t pid, VAddr site, const ThreadContext* context) {
+    if(ThreadContext::skipping) {
+        currentSite.at(pid) = 0;
+        return;
+    }
+    if(sites.find(site) == sites.end()) {
+        sites[site].name = symbolize(site, context);
+    }
+    currentSite.at(pid) = site;
+    startedAt[pid]      = globalClock;
+    aborterSite[pid]    = 0;
+    abortLine[pid]      = 0;
+}
+
+void TMProfiler::markAbort(Pid_t pid, Pid_t aborterPid, VAddr caddr) {
+    aborterSite.at(pid) = aborterPid == INVALID_PID ? 0 : currentSite.at(aborterPid);
+    abortLine[pid]      = caddr;
+}
+
+void TMProfiler::commit(Pid_t pid) {
+    if(currentSite.at(pid) == 0) {
+        return;
+    }
+    if(ThreadContext::skipping) {
+        currentSite[pid] = 0;
+        return;
+    }
+    SiteProfile& profile = sites[currentSite[pid]];
+    profile.commits++;
+    profile.committedCycles += globalClock - startedAt[pid];
+    currentSite[pid] = 0;
+}
+
+void TMProfiler::abort(Pid_t pid, TMAbortType_e abortType) {
+    if(currentSite.at(pid) == 0) {
+        return;
+    }
+    if(ThreadContext::skipping) {
+        currentSite[pid] = 0;
+        return;
+    }
+    SiteProfile& profile = sites[currentSite[pid]];
+    profile.aborts++;
+    if(abortType < NumAbortTypes) {
+        profile.abortsByType[abortType]++;
+    }
+    profile.wastedCycles += globalClock - startedAt[pid];
+    // User and syscall aborts have no data line
+    if(abortLine[pid] != 0) {
+        profile.lines[abortLine[pid]]++;
+        profile.conflicts[make_pair(aborterSite[pid], abortLine[pid])]++;
+    }
+    currentSite[pid] = 0;
+}
+
+///
+// Helper to sort (key, count) pairs by decreasing count
+template<class T>
+static bool moreCounts(const pair<T, uint64_t>& a, const pair<T, uint64_t>& b) {
+    if(a.second != b.second) {
+        return a.second > b.second;
+    }
+    return a.first < b.first;
+}
+
+void TMProfiler::report(const char *str) const {
+    Report::field("BEGIN TMProfiler::report %s", str);
+
+    // Sites with the most wasted cycles first
+    vector<pair<VAddr, uint64_t> > order;
+    HASH_MAP<VAddr, uint64_t> allLines;
+    for(HASH_MAP<VAddr, SiteProfile>::const_iterator it = sites.begin(); it != sites.end(); ++it) {
+        order.push_back(make_pair(it->first, it->second.wastedCycles));
+        for(HASH_MAP<VAddr, uint64_t>::const_iterator l = it->second.lines.begin(); l != it->second.lines.end(); ++l) {
+            allLines[l->first] += l->second;
+        }
+    }
+    sort(order.begin(), order.end(), moreCounts<VAddr>);
+
+    for(size_t i = 0; i < order.size(); i++) {
+        VAddr site = order[i].first;
+        const SiteProfile& profile = sites.find(site)->second;
+
+        Report::field("TMProfile(0x%lx):func=%s:commits=%llu:aborts=%llu:committedCycles=%llu:wastedCycles=%llu",
+            site, profile.name.empty() ? "?" : profile.name.c_str(),
+            profile.commits, profile.aborts, profile.committedCycles, profile.wastedCycles);
+        for(int t = 0; t < NumAbortTypes; t++) {
+            if(profile.abortsByType[t]) {
+                Report::field("TMProfile(0x%lx):%sAborts=%llu", site, abortTypeNames[t], profile.abortsByType[t]);
+            }
+        }
+
+        // Aborter site 0 is a non-transactional access
+        vector<pair<pair<VAddr, VAddr>, uint64_t> > conflicts(profile.conflicts.begin(), profile.conflicts.end());
+        sort(conflicts.begin(), conflicts.end(), moreCounts<pair<VAddr, VAddr> >);
+        for(size_t c = 0; c < conflicts.size() && c < nTop; c++) {
+            Report::field("TMProfile(0x%lx):conflict(0x%lx,0x%lx)=%llu",
+                site, conflicts[c].first.first, conflicts[c].first.second, conflicts[c].second);
+        }
+
+        vector<pair<VAddr, uint64_t> > lines(profile.lines.begin(), profile.lines.end());
+        sort(lines.begin(), lines.end(), moreCounts<VAddr>);
+        for(size_t l = 0; l < lines.size() && l < nTop; l++) {
+            Report::field("TMProfile(0x%lx):line(0x%lx)=%llu", site, lines[l].first, lines[l].second);
+        }
+    }
+
+    vector<pair<VAddr, uint64_t> > lines(allLines.begin(), allLines.end());
+    sort(lines.begin(), lines.end(), moreCounts<VAddr>);
+    for(size_t l = 0; l < lines.size() && l < nTop; l++) {
+        Report::field("TMProfile:topLine(0x%lx)=%llu", lines[l].first, lines[l].second);
+    }
+
+    Report::field("END TMProfiler::report %s", str);
+}
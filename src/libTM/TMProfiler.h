@@ -0,0 +1,76 @@
+#ifndef TM_PROFILER
+#define TM_PROFILER
+
+#include <map>
+#include <string>
+#include <vector>
+#include "estl.h"
+#include "Snippets.h"
+#include "TMState.h"
+
+// Forward defs instead of ThreadContext.h
+class ThreadContext;
+
+///
+// Per atomic block profile of the transactions (abortProfiler), written with
+// the report. An atomic block is identified by its site: the tm_begin call
+// of the application, or the tm.begin instruction when there is no tmlib
+// call. For each site it counts the commits, the aborts of each type, the
+// cycles of committed and of aborted (wasted) attempts, the (aborter site,
+// data line) pairs of the aborts and the data lines that caused them. The
+// sites are reported by wasted cycles, with the abortProfilerTop first pairs
+// and lines of each one, and then the top lines of all the sites together.
+// Transactions run in rabbit mode (-w, sampling) are not profiled.
+class TMProfiler {
+public:
+    // Returns NULL if the profiler is disabled (abortProfiler)
+    static TMProfiler *create(size_t nThreads);
+
+    TMProfiler(size_t nThreads, size_t nTop);
+
+    void begin(Pid_t pid, VAddr site, const ThreadContext* context);
+    // Remember who aborted pid (the abort completes later)
+    void markAbort(Pid_t pid, Pid_t aborterPid, VAddr caddr);
+    void commit(Pid_t pid);
+    void abort(Pid_t pid, TMAbortType_e abortType);
+
+    void report(const char *str) const;
+private:
+    static const int NumAbortTypes = TM_ATYPE_FALSEPOS + 1;
+
+    struct SiteProfile {
+        SiteProfile(): commits(0), aborts(0), committedCycles(0), wastedCycles(0) {
+            for(int t = 0; t < NumAbortTypes; t++) {
+                abortsByType[t] = 0;
+            }
+        }
+        // Function and offset of the site, empty if unknown
+        std::string name;
+        uint64_t    commits;
+        uint64_t    aborts;
+        uint64_t    abortsByType[NumAbortTypes];
+        uint64_t    committedCycles;
+        uint64_t    wastedCycles;
+        // Aborts per data line
+        HASH_MAP<VAddr, uint64_t>                       lines;
+        // Aborts per (site of the aborter, data line)
+        std::map<std::pair<VAddr, VAddr>, uint64_t>     conflicts;
+    };
+
+    static std::string symbolize(VAddr site, const ThreadContext* context);
+
+    // Configurable member variables
+    size_t          nTop;
+
+    // State member variables
+    HASH_MAP<VAddr, SiteProfile>    sites;
+    // Site (0 outside transactions) and start of the current transaction of
+    // each thread
+    std::vector<VAddr>              currentSite;
+    std::vector<Time_t>             startedAt;
+    // Site of the aborter and data line of the pending abort of each thread
+    std::vector<VAddr>              aborterSite;
+    std::vector<VAddr>              abortLine;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include <string.h>
+#include "nanassert.h"
+#include "SescConf.h"
+#include "libemul/EmulInit.h"
+#include "TMScheduler.h"
+
+using namespace std;
+
+///
+// Factory function, reads the scheduler options of the TransactionalMemory
+// section
+TMScheduler *TMScheduler::create(size_t nThreads) {
+    if(!SescConf->checkCharPtr("TransactionalMemory", "schedulerPolicy")) {
+        return NULL;
+    }
+    const char *policy = SescConf->getCharPtr("TransactionalMemory", "schedulerPolicy");
+    if(strcasecmp(policy, "None") == 0) {
+        return NULL;
+    } else if(strcasecmp(policy, "ATS") != 0) {
+        fail("Unknown schedulerPolicy %s (None or ATS)\n", policy);
+    }
+
+    double alpha = 0.3;
+    if(SescConf->checkDouble("TransactionalMemory", "atsAlpha")) {
+        alpha = SescConf->getDouble("TransactionalMemory", "atsAlpha");
+    }
+    double threshold = 0.5;
+    if(SescConf->checkDouble("TransactionalMemory", "atsThreshold")) {
+        threshold = SescConf->getDouble("TransactionalMemory", "atsThreshold");
+    }
+    uint32_t retryCycles = 20;
+    if(SescConf->checkInt("TransactionalMemory", "atsRetryCycles")) {
+        retryCycles = SescConf->getInt("TransactionalMemory", "atsRetryCycles");
+    }
+    if(alpha < 0 || alpha > 1 || threshold < 0 || threshold > 1) {
+        fail("atsAlpha (%g) and atsThreshold (%g) must be in [0,1]\n", alpha, threshold);
+    }
+
+    MSG("Using ATS transaction scheduling (alpha %g, threshold %g, retry %u cycles)", alpha, threshold, retryCycles);
+    return new TMScheduler(nThreads, alpha, threshold, retryCycles);
+}
+
+TMScheduler::TMScheduler(size_t nThreads, double a, double t, uint32_t r):
+        alpha(a),
+        threshold(t),
+        retryCycles(r),
+        serializedBegins("tm:atsSerializedBegins"),
+        beginNacks("tm:atsBeginNacks"),
+        queueLength("tm:atsQueueLength"),
+        intensity(nThreads, 0.0),
+        queued(nThreads, false) {
+}
+
+///
+// A thread under contention enters the queue and begins once it is at the
+// head. The head keeps its place until its transaction commits or aborts.
+bool TMScheduler::canBegin(Pid_t pid) {
+    if(!queued.at(pid)) {
+        if(intensity[pid] <= threshold) {
+            return true;
+        }
+        queued[pid] = true;
+        queue.push_back(pid);
+        queueLength.sample(queue.size());
+    }
+    if(queue.front() == pid) {
+        serializedBegins.inc();
+        return true;
+    }
+    beginNacks.inc();
+    return false;
+}
+
+void TMScheduler::release(Pid_t pid, bool aborted) {
+    intensity.at(pid) = alpha * intensity[pid] + (aborted ? 1.0 - alpha : 0.0);
+
+    // Not necessarily the head: the queue is bypassed in rabbit mode
+    if(queued[pid]) {
+        queue.remove(pid);
+        queued[pid] = false;
+    }
+}
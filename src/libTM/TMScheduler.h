@@ -0,0 +1,50 @@
+#ifndef TM_SCHEDULER
+#define TM_SCHEDULER
+
+#include <list>
+#include <vector>
+#include "Snippets.h"
+#include "GStats.h"
+
+///
+// Adaptive transaction scheduling (ATS) in front of HTMManager::begin, for
+// any TM method. Each thread keeps a contention intensity
+//   CI = alpha * CI + (1 - alpha) * (1 if the transaction aborted, else 0)
+// updated when a transaction commits or aborts. A thread whose CI is above
+// the threshold is serialized: its tm.begin waits in a central FIFO queue,
+// and only the thread at the head runs a transaction until it commits or
+// aborts. Threads below the threshold begin freely.
+class TMScheduler {
+public:
+    // Returns NULL if the scheduler is disabled (schedulerPolicy)
+    static TMScheduler *create(size_t nThreads);
+
+    TMScheduler(size_t nThreads, double alpha, double threshold, uint32_t retryCycles);
+
+    // Returns false if pid has to wait and retry its tm.begin later
+    bool canBegin(Pid_t pid);
+    void commit(Pid_t pid) { release(pid, false); }
+    void abort(Pid_t pid)  { release(pid, true); }
+
+    uint32_t getRetryCycles() const { return retryCycles; }
+    double   getIntensity(Pid_t pid) const { return intensity.at(pid); }
+private:
+    void release(Pid_t pid, bool aborted);
+
+    // Configurable member variables
+    double          alpha;
+    double          threshold;
+    uint32_t        retryCycles;
+
+    // Statistics
+    GStatsCntr      serializedBegins;
+    GStatsCntr      beginNacks;
+    GStatsAvg       queueLength;
+
+    // State member variables
+    std::vector<double>     intensity;
+    std::vector<bool>       queued;
+    std::list<Pid_t>        queue;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "nanassert.h"
+#include "SescConf.h"
+#include "libemul/EmulInit.h"
+#include "TMSignature.h"
+
+TMSigHash::TMSigHash(size_t nBits, int nHashes, Kind kind, int lineSize, uint32_t seed):
+        nHashes(nHashes),
+        kind(kind),
+        lineShift(0),
+        log2Bits(0) {
+
+    if(nBits < 64 || (nBits & (nBits - 1)) != 0) {
+        fail("TM signature size must be a power of two of at least 64 bits: %lu\n", nBits);
+    }
+    if(nHashes < 1 || nHashes > TMSigKey::MaxHashes) {
+        fail("TM signature must have 1 to %d hash functions: %d\n", TMSigKey::MaxHashes, nHashes);
+    }
+    while((1 << lineShift) < lineSize) {
+        lineShift++;
+    }
+    while(((size_t)1 << log2Bits) < nBits) {
+        log2Bits++;
+    }
+    bitMask = nBits - 1;
+
+    if(kind == H3) {
+        struct random_data randBuf;
+        char rbuf[32];
+        memset(rbuf, 0, sizeof(rbuf));
+        memset(&randBuf, 0, sizeof(randBuf));
+        initstate_r(seed, rbuf, sizeof(rbuf), &randBuf);
+        for(int i = 0; i < nHashes * 32; i++) {
+            int32_t r;
+            random_r(&randBuf, &r);
+            h3.push_back((uint32_t)r & bitMask);
+        }
+    }
+}
+
+TMSigHash::Kind TMSigHash::parseKind(const char *name) {
+    if(strcasecmp(name, "BitSelect") == 0) {
+        return BitSelect;
+    } else if(strcasecmp(name, "H3") == 0) {
+        return H3;
+    }
+    fail("Unknown TM signature hash %s (BitSelect or H3)\n", name);
+    return H3;
+}
+
+///
+// invertSeed gives other H3 values for the same randomSeed (e.g. the SigTM
+// write signature)
+TMSigHash TMSigHash::create(const char *bitsName, size_t nBits, const char *hashesName, int nHashes,
+                            int lineSize, bool invertSeed) {
+    if(SescConf->checkInt("TransactionalMemory", bitsName)) {
+        nBits = SescConf->getInt("TransactionalMemory", bitsName);
+    }
+    if(SescConf->checkInt("TransactionalMemory", hashesName)) {
+        nHashes = SescConf->getInt("TransactionalMemory", hashesName);
+    }
+    Kind kind = H3;
+    if(SescConf->checkCharPtr("TransactionalMemory", "sigHash")) {
+        kind = parseKind(SescConf->getCharPtr("TransactionalMemory", "sigHash"));
+    }
+    uint32_t seed = 1;
+    if(SescConf->checkInt("TransactionalMemory", "randomSeed")) {
+        seed = SescConf->getInt("TransactionalMemory", "randomSeed");
+    }
+    if(invertSeed) {
+        seed = ~seed;
+    }
+    return TMSigHash(nBits, nHashes, kind, lineSize, seed);
+}
+
+size_t TMSignature::getNumSetBits() const {
+    size_t nSet = 0;
+    for(size_t w = 0; w < words.size(); w++) {
+        nSet += __builtin_popcountll(words[w]);
+    }
+    return nSet;
+}
@@ -0,0 +1,106 @@
+#ifndef TM_SIGNATURE
+#define TM_SIGNATURE
+
+#include <vector>
+#include <algorithm>
+#include "Snippets.h"
+#include "libemul/Addressing.h"
+
+///
+// Bit positions of a cache line in a signature, one per hash function. They
+// are computed once per access and then tested against the signature of each
+// thread.
+struct TMSigKey {
+    static const int MaxHashes = 8;
+    uint32_t bit[MaxHashes];
+};
+
+///
+// Hash functions of a signature: nHashes functions that map a cache line to
+// one of nBits bits (a power of two).
+//   BitSelect: function i uses log2(nBits) line address bits starting at
+//              bit i*log2(nBits).
+//   H3:        function i XORs a random value per line address bit that is
+//              set (H3 family), so all the address bits count.
+class TMSigHash {
+public:
+    enum Kind { BitSelect, H3 };
+
+    TMSigHash(size_t nBits, int nHashes, Kind kind, int lineSize, uint32_t seed);
+
+    void getKey(VAddr caddr, TMSigKey& key) const {
+        uint32_t line = (uint32_t)(caddr >> lineShift);
+        for(int h = 0; h < nHashes; h++) {
+            if(kind == BitSelect) {
+                uint32_t shift = (h * log2Bits) % 32;
+                key.bit[h] = ((line >> shift) | (line << ((32 - shift) % 32))) & bitMask;
+            } else {
+                const uint32_t *q = &h3[h * 32];
+                uint32_t idx = 0;
+                for(uint32_t l = line; l; l &= l - 1) {
+                    idx ^= q[__builtin_ctz(l)];
+                }
+                key.bit[h] = idx;
+            }
+        }
+    }
+
+    size_t getNumBits() const { return bitMask + 1; }
+    int getNumHashes() const { return nHashes; }
+    static Kind parseKind(const char *name);
+    // Hash of the bitsName/hashesName options of the TransactionalMemory
+    // section (nBits/nHashes by default), with the sigHash and randomSeed
+    // options that all the signatures share
+    static TMSigHash create(const char *bitsName, size_t nBits, const char *hashesName, int nHashes,
+                            int lineSize, bool invertSeed);
+private:
+    int             nHashes;
+    Kind            kind;
+    int             lineShift;
+    uint32_t        log2Bits;
+    uint32_t        bitMask;
+    // H3 values, 32 per function
+    std::vector<uint32_t> h3;
+};
+
+///
+// Read or write set of a transaction summarized as a bloom filter. Lookups
+// never miss a line that was inserted, but other lines may alias with it
+// (false positives).
+class TMSignature {
+public:
+    TMSignature(const TMSigHash *h): hash(h), words((h->getNumBits() + 63) / 64, 0), nInserted(0) {}
+
+    void insert(const TMSigKey& key) {
+        for(int h = 0; h < hash->getNumHashes(); h++) {
+            words[key.bit[h] >> 6] |= ((uint64_t)1) << (key.bit[h] & 63);
+        }
+        nInserted++;
+    }
+    bool mayContain(const TMSigKey& key) const {
+        if(nInserted == 0) {
+            return false;
+        }
+        for(int h = 0; h < hash->getNumHashes(); h++) {
+            if(((words[key.bit[h] >> 6] >> (key.bit[h] & 63)) & 1) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    void clear() {
+        if(nInserted) {
+            std::fill(words.begin(), words.end(), 0);
+            nInserted = 0;
+        }
+    }
+    bool empty() const { return nInserted == 0; }
+    size_t getNumInserted() const { return nInserted; }
+    size_t getNumSetBits() const;
+private:
+    const TMSigHash         *hash;
+    std::vector<uint64_t>   words;
+    size_t                  nInserted;
+};
+
+#endif
@@ -29,6 +29,7 @@ enum TMAbortType_e {
     TM_ATYPE_SYSCALL            = 2,    // Aborts due to syscall (external abort)
     TM_ATYPE_SETCONFLICT        = 3,    // Aborts due to a set conflict (capacity)
     TM_ATYPE_NONTM              = 4,    // Aborts due to conflict by a non-transaction
+    TM_ATYPE_FALSEPOS           = 5,    // Aborts due to a signature false positive (no real conflict)
     TM_ATYPE_INVALID            = 0xDEAD
 };
 
@@ -36,6 +37,7 @@ enum TMAbortType_e {
 enum TMBeginSubtype {
     TM_BEGIN_INVALID            = 0, // Uninitialized
     TM_BEGIN_REGULAR            = 1, // If the transaction started without problems
+    TM_BEGIN_NACKED             = 2, // The begin has to be retried (delayed by the scheduler)
 
     TM_COMPLETE_ABORT           = 9, // Aborted transaction 're-executes' TMBegin with this state
 };
@@ -45,6 +47,7 @@ enum TMCommitSubtype {
     TM_COMMIT_INVALID           = 0, // Unitialized
     TM_COMMIT_REGULAR           = 1, // If the transaction has committed
     TM_COMMIT_ABORTED           = 2, // The transaction failed to commit
+    TM_COMMIT_NACKED            = 3, // The commit has to be retried (commit arbitration failed)
 };
 
 class TMAbortState {
@@ -1,34 +1,125 @@
-
+#include <algorithm>
 #include "TMStorage.h"
 #include "libll/ThreadContext.h"
 
 using namespace std;
 
-TMStorage2::CacheLine::CacheLine(): dirty(false) {
-    std::fill(data, data + CACHE_SIZE, 0);
+const uint32_t TMStorage2::NoLine;
+bool TMStorage2::mergeBytes = false;
+
+TMStorage2::TMStorage2(): index(64, NoLine), tableMask(63), lastCAddr(0), lastLine(NoLine),
+        flushBuf(AddressSpace::getPageSize()) {
+    memset(filter, 0, sizeof(filter));
+}
+
+///
+// Return the id of the line holding cAddr, or NoLine
+uint32_t TMStorage2::findLine(VAddr cAddr) {
+    if(lastLine != NoLine && lastCAddr == cAddr) {
+        return lastLine;
+    }
+    if(filterMayContain(cAddr) == false) {
+        return NoLine;
+    }
+    for(size_t slot = hashSlot(cAddr); index[slot] != NoLine; slot = (slot + 1) & tableMask) {
+        if(lines[index[slot]].caddr == cAddr) {
+            lastCAddr = cAddr;
+            lastLine  = index[slot];
+            return lastLine;
+        }
+    }
+    return NoLine;
+}
+void TMStorage2::insertIndex(uint32_t lineId) {
+    size_t slot = hashSlot(lines[lineId].caddr);
+    while(index[slot] != NoLine) {
+        slot = (slot + 1) & tableMask;
+    }
+    index[slot] = lineId;
+}
+void TMStorage2::growIndex() {
+    tableMask = (tableMask << 1) | 1;
+    index.assign(tableMask + 1, NoLine);
+    for(uint32_t lineId = 0; lineId < lines.size(); lineId++) {
+        insertIndex(lineId);
+    }
 }
+
 void TMStorage2::loadLine(ThreadContext* context, VAddr addr) {
-    if(inTnxStorage(addr) == false) {
-        CacheLine line;
-        VAddr cAddr = computeCAddr(addr);
-        for(uint32_t offset = 0; offset < CACHE_SIZE; offset += sizeof(uint32_t)) {
-            uint32_t word  = context->readMemRaw<uint32_t>(cAddr + offset);
-            *(reinterpret_cast<uint32_t*>(line.data + offset)) = word;
+    VAddr cAddr = computeCAddr(addr);
+    if(findLine(cAddr) == NoLine) {
+        // Keep the load factor under 1/2
+        if(2 * (lines.size() + 1) > tableMask + 1) {
+            growIndex();
+        }
+        lines.resize(lines.size() + 1);
+        CacheLine& line = lines.back();
+        line.caddr = cAddr;
+        line.dirtyBytes = 0;
+        // With mergeBytes only the written bytes are used
+        if(!mergeBytes) {
+            context->getAddressSpace()->readBlock(cAddr, line.data, CACHE_SIZE);
         }
-        tnxStorage.insert(make_pair(cAddr, line));
+
+        uint32_t lineId = lines.size() - 1;
+        insertIndex(lineId);
+        filterInsert(cAddr);
+        lastCAddr = cAddr;
+        lastLine  = lineId;
     }
 }
+
+///
+// Write back the dirty lines in address order. Lines that are contiguous in
+// the same page are written with a single page access. With mergeBytes, runs
+// with partially written lines are read first, so only the written bytes
+// change.
 void TMStorage2::flush(ThreadContext* context) {
-    TnxStorage::iterator iStorage = tnxStorage.begin();
-    for(iStorage; iStorage != tnxStorage.end(); ++iStorage) {
-        VAddr cAddr = iStorage->first;
-        CacheLine& line = iStorage->second;
-        if(line.dirty) {
-            for(uint32_t offset = 0; offset < CACHE_SIZE; offset += sizeof(uint32_t)) {
-                uint32_t word = *(reinterpret_cast<uint32_t*>(line.data + offset));
-                context->writeMemRaw<uint32_t>(cAddr + offset, word);
+    vector<pair<VAddr, uint32_t> > dirtyLines;
+    for(uint32_t lineId = 0; lineId < lines.size(); lineId++) {
+        if(lines[lineId].dirtyBytes) {
+            dirtyLines.push_back(make_pair(lines[lineId].caddr, lineId));
+        }
+    }
+    sort(dirtyLines.begin(), dirtyLines.end());
+
+    AddressSpace* addressSpace = context->getAddressSpace();
+    const size_t pageSize = AddressSpace::getPageSize();
+    uint8_t *buf = &flushBuf[0];
+    size_t i = 0;
+    while(i < dirtyLines.size()) {
+        VAddr runStart = dirtyLines[i].first;
+        size_t runBegin = i;
+        size_t runLen = 0;
+        bool partial = false;
+        while(i < dirtyLines.size()
+                && dirtyLines[i].first == runStart + runLen
+                && (runStart + runLen) / pageSize == runStart / pageSize) {
+            partial = partial || (mergeBytes && lines[dirtyLines[i].second].dirtyBytes != ~((uint64_t)0));
+            runLen += CACHE_SIZE;
+            i++;
+        }
+        if(partial) {
+            addressSpace->readBlock(runStart, buf, runLen);
+        }
+        for(size_t l = runBegin; l < i; l++) {
+            const CacheLine& line = lines[dirtyLines[l].second];
+            uint8_t *dst = buf + (line.caddr - runStart);
+            if(!mergeBytes || line.dirtyBytes == ~((uint64_t)0)) {
+                memcpy(dst, line.data, CACHE_SIZE);
+            } else {
+                for(size_t b = 0; b < CACHE_SIZE; b++) {
+                    if((line.dirtyBytes >> b) & 1) {
+                        dst[b] = line.data[b];
+                    }
+                }
             }
         }
+        addressSpace->writeBlock(runStart, buf, runLen);
     }
-	tnxStorage.clear();
+
+    lines.clear();
+    index.assign(index.size(), NoLine);
+    memset(filter, 0, sizeof(filter));
+    lastLine = NoLine;
 }
@@ -1,17 +1,32 @@
 #ifndef TM_CACHE
 #define TM_CACHE
 
-#include <map>
+#include <vector>
+#include <string.h>
 #include "libemul/Addressing.h"
 class ThreadContext;
 
+///
+// Speculative storage of a transaction. Lines live inline in a vector (in the
+// order they were loaded) and are found through a small open-addressing table.
+// A bloom filter in front of the table answers most "not in storage" queries.
+// A line is a snapshot of memory taken on the first access of the
+// transaction, and the commit writes back the whole line. With sub-block
+// conflict detection (mergeBytes) other transactions may commit to the rest of
+// the line, so lines are not snapshotted: each line keeps a mask of the bytes
+// written by the transaction, loads only take those bytes from the storage
+// (the rest comes from memory), and the commit only writes them back.
 class TMStorage2 {
   const static size_t CACHE_SIZE = 64;
   struct CacheLine {
-    CacheLine();
     uint8_t data[CACHE_SIZE];
-    bool dirty;
+    VAddr caddr;
+    uint64_t dirtyBytes;
   };
+  template<class T>
+  static uint64_t byteMask(size_t cOff) {
+      return ((((uint64_t)1) << sizeof(T)) - 1) << cOff;
+  }
   VAddr computeCAddr(VAddr addr) {
       return ((addr / CACHE_SIZE) * CACHE_SIZE);
   }
@@ -24,18 +39,19 @@ class TMStorage2 {
 
   public:
     /* Contructor */
-    TMStorage2() {}
+    TMStorage2();
+
+    // Set when conflicts are detected per sub-block
+    static bool mergeBytes;
 
     bool inTnxStorage(VAddr addr) {
-        VAddr cAddr = computeCAddr(addr);
-        TnxStorage::iterator iStorage = tnxStorage.find(cAddr);
-        return iStorage != tnxStorage.end();
+        return findLine(computeCAddr(addr)) != NoLine;
     }
 	template<class T>
-    T load(VAddr addr);
+    T load(ThreadContext *context, VAddr addr, T oval);
 	template<class T>
     void store(ThreadContext *context, VAddr addr, T val);
-   
+
     void loadLine(ThreadContext* context, VAddr addr);
 	void flush(ThreadContext* context);
 
@@ -43,36 +59,84 @@ class TMStorage2 {
     ~TMStorage2() {}
 
   private:
+     const static uint32_t NoLine = ~((uint32_t)0);
+     const static size_t FILTER_BITS = 4096;
+     const static size_t FILTER_WORDS = FILTER_BITS / 64;
+
+     size_t hashSlot(VAddr cAddr) const {
+         return (size_t)(((cAddr / CACHE_SIZE) * 0x9E3779B97F4A7C15ULL) >> 32) & tableMask;
+     }
+     uint64_t filterBit(VAddr cAddr, int32_t h) const {
+         uint64_t key = (cAddr / CACHE_SIZE) * (h ? 0xC2B2AE3D27D4EB4FULL : 0x9E3779B97F4A7C15ULL);
+         return key >> (64 - 12);
+     }
+     bool filterMayContain(VAddr cAddr) const {
+         uint64_t b0 = filterBit(cAddr, 0);
+         uint64_t b1 = filterBit(cAddr, 1);
+         return ((filter[b0 / 64] >> (b0 % 64)) & 1) && ((filter[b1 / 64] >> (b1 % 64)) & 1);
+     }
+     void filterInsert(VAddr cAddr) {
+         uint64_t b0 = filterBit(cAddr, 0);
+         uint64_t b1 = filterBit(cAddr, 1);
+         filter[b0 / 64] |= ((uint64_t)1) << (b0 % 64);
+         filter[b1 / 64] |= ((uint64_t)1) << (b1 % 64);
+     }
+     uint32_t findLine(VAddr cAddr);
+     void     insertIndex(uint32_t lineId);
+     void     growIndex();
 
-     typedef std::map<VAddr, CacheLine> TnxStorage;
-     TnxStorage tnxStorage; //!< Speculative storage
+     std::vector<CacheLine> lines;      //!< Speculative storage
+     std::vector<uint32_t>  index;      //!< Line ids, NoLine if the slot is empty
+     size_t                 tableMask;
+     uint64_t               filter[FILTER_WORDS];
+     VAddr                  lastCAddr;  //!< Last line found (load/store follow loadLine)
+     uint32_t               lastLine;
+     std::vector<uint8_t>   flushBuf;   //!< One page, runs of lines written by flush
 };
 
+///
+// Value at addr. With mergeBytes, the bytes written by the transaction and the
+// rest from oval (the value in memory).
 template<class T>
-T TMStorage2::load(VAddr addr)
+T TMStorage2::load(ThreadContext *context, VAddr addr, T oval)
 {
-    T myRV = 0;
     VAddr cAddr = computeCAddr(addr);
     VAddr cOff = computeCOffset(addr);
-    TnxStorage::iterator iStorage = tnxStorage.find(cAddr);
-    if(iStorage != tnxStorage.end()) {
-        CacheLine& line = iStorage->second;
-        myRV = *(reinterpret_cast<T*>(line.data + cOff));
-        return myRV;
-    } else {
-        return 0xCC;
+    if(!mergeBytes) {
+        loadLine(context, addr);
+        return *(reinterpret_cast<T*>(lines[lastLine].data + cOff));
+    }
+    uint32_t lineId = findLine(cAddr);
+    if(lineId == NoLine) {
+        return oval;
+    }
+    CacheLine& line = lines[lineId];
+    uint64_t mask  = byteMask<T>(cOff);
+    uint64_t dirty = line.dirtyBytes & mask;
+    if(dirty == mask) {
+        return *(reinterpret_cast<T*>(line.data + cOff));
+    } else if(dirty == 0) {
+        return oval;
+    }
+    T myRV = oval;
+    uint8_t *p = reinterpret_cast<uint8_t*>(&myRV);
+    for(size_t b = 0; b < sizeof(T); b++) {
+        if((line.dirtyBytes >> (cOff + b)) & 1) {
+            p[b] = line.data[cOff + b];
+        }
     }
+    return myRV;
 }
 
 template<class T>
 void TMStorage2::store(ThreadContext *context, VAddr addr, T val) {
     VAddr cAddr = computeCAddr(addr);
     VAddr cOff = computeCOffset(addr);
-    TnxStorage::iterator iStorage = tnxStorage.find(cAddr);
-    if(iStorage != tnxStorage.end()) {
-        CacheLine& line = iStorage->second;
+    uint32_t lineId = findLine(cAddr);
+    if(lineId != NoLine) {
+        CacheLine& line = lines[lineId];
         *(reinterpret_cast<T*>(line.data + cOff)) = val;
-        line.dirty = true;
+        line.dirtyBytes |= byteMask<T>(cOff);
     }
 }
 
@@ -17,19 +17,15 @@ TSXManager::TSXManager(const char tmStyle[], int32_t nCores, int32_t line):
         invMsg("tm:invMsg"),
         flushMsg("tm:flushMsg"),
         fwdGetSConflictMsg("tm:fwdGetSConflictMsg"),
-        invConflictMsg("tm:invConflictMsg")  {
+        invConflictMsg("tm:invConflictMsg"),
+        directory(line),
+        overflow(nThreads, line) {
 
     int totalSize = SescConf->getInt("TransactionalMemory", "totalSize");
     int assoc = SescConf->getInt("TransactionalMemory", "assoc");
-    if(SescConf->checkInt("TransactionalMemory","overflowSize")) {
-        maxOverflowSize = SescConf->getInt("TransactionalMemory","overflowSize");
-    } else {
-        maxOverflowSize = 4;
-        MSG("Using default overflow size of %ld\n", maxOverflowSize);
-    }
 
     for(int coreId = 0; coreId < nCores; coreId++) {
-        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1));
+        caches.push_back(new CacheAssocTM(totalSize, assoc, lineSize, 1, &directory, coreId));
     }
 }
 
@@ -50,9 +46,7 @@ void TSXManager::updateOverflow(Pid_t pid, VAddr newCaddr) {
     getPeers(pid, peers);
 
     for(Pid_t peer: peers) {
-        if(overflow[peer].find(newCaddr) != overflow[peer].end()) {
-            overflow[peer].erase(newCaddr);
-        }
+        overflow.remove(peer, newCaddr);
     }
 }
 
@@ -86,12 +80,13 @@ TSXManager::Line* TSXManager::replaceLine(Pid_t pid, VAddr raddr) {
             // Dirty transactional lines always trigger set conflict
             markTransAborted(replaced->getWriter(), pid, replaced->getCaddr(), TM_ATYPE_SETCONFLICT);
         } else {
-            // Clean lines only do so on overflow set overflows
+            // Clean lines only do so on overflow set overflows. An overflow
+            // signature replaces the exact read set for the line.
             for(Pid_t reader: replaced->getReaders()) {
-                if(overflow[reader].size() < maxOverflowSize) {
-                    overflow[reader].insert(replaced->getCaddr());
-                } else {
+                if(overflow.insert(reader, replaced->getCaddr()) == false) {
                     markTransAborted(reader, pid, replaced->getCaddr(), TM_ATYPE_SETCONFLICT);
+                } else if(overflow.usesSignature()) {
+                    rwSetManager.dropRead(reader, replaced->getCaddr());
                 }
             }
         }
@@ -114,9 +109,9 @@ TSXManager::Line* TSXManager::replaceLine(Pid_t pid, VAddr raddr) {
 // Helper function that aborts all transactional readers
 void TSXManager::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except) {
     // Collect writers
-    set<Pid_t> aborted;
-    rwSetManager.getWriters(caddr, aborted);
+    PidMask aborted = rwSetManager.getWriters(caddr);
     aborted.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     TMAbortType_e abortType = isTM ? TM_ATYPE_DEFAULT : TM_ATYPE_NONTM;
 
@@ -139,10 +134,11 @@ void TSXManager::abortTMWriters(Pid_t pid, VAddr caddr, bool isTM, std::set<Cach
 // Helper function that aborts all transactional readers and writers
 void TSXManager::abortTMSharers(Pid_t pid, VAddr caddr, bool isTM, std::set<Cache*>& except) {
     // Collect sharers
-    set<Pid_t> aborted;
-    rwSetManager.getWriters(caddr, aborted);
-    rwSetManager.getReaders(caddr, aborted);
+    PidMask aborted = rwSetManager.getSharers(caddr);
+    // Readers of overflowed lines are only in the overflow signatures
+    overflow.getSigHits(pid, caddr, aborted);
     aborted.erase(pid);
+    addSubBlockSharers(caddr, except);
 
     TMAbortType_e abortType = isTM ? TM_ATYPE_DEFAULT : TM_ATYPE_NONTM;
 
@@ -154,7 +150,7 @@ void TSXManager::abortTMSharers(Pid_t pid, VAddr caddr, bool isTM, std::set<Cach
             Line* line = cache->findLine(caddr);
             if(line) {
                 line->clearTransactional(a);
-            } else if(overflow[a].find(caddr) == overflow[a].end() && getTMState(a) == TMStateEngine::TM_RUNNING) {
+            } else if(overflow.mayContain(a, caddr) == false && getTMState(a) == TMStateEngine::TM_RUNNING) {
                 fail("[%d] Aborting non-sharer %d?: 0x%lx", pid, a, caddr);
             }
         }
@@ -167,7 +163,7 @@ void TSXManager::cleanDirtyLines(Pid_t pid, VAddr caddr, std::set<Cache*>& excep
     getSMsg.inc();
 
     Cache* myCache = getCache(pid);
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(caddr)) {
         Cache* cache = caches.at(cid);
         Line* line = cache->findLine(caddr);
         if(line && line->isValid() && line->isDirty()) {
@@ -193,7 +189,7 @@ void TSXManager::invalidateLines(Pid_t pid, VAddr caddr, std::set<Cache*>& excep
     getMMsg.inc();
 
     Cache* myCache = getCache(pid);
-    for(size_t cid = 0; cid < caches.size(); cid++) {
+    for(Pid_t cid: directory.getHolders(caddr)) {
         Cache* cache = caches.at(cid);
         Line* line = cache->findLine(caddr);
         if(line && line->isValid()) {
@@ -365,7 +361,7 @@ TMBCStatus TSXManager::myCommit(InstDesc* inst, const ThreadContext* context, In
     for(Line* line: lines) {
         line->clearTransactional(pid);
     }
-    overflow[pid].clear();
+    overflow.clear(pid);
 
     return TMBC_SUCCESS;
 }
@@ -386,6 +382,6 @@ void TSXManager::myStartAborting(InstDesc* inst, const ThreadContext* context, I
             line->clearTransactional(pid);
         }
     }
-    overflow[pid].clear();
+    overflow.clear(pid);
 }
 
@@ -6,6 +6,7 @@
 #include <vector>
 #include "HTMManager.h"
 #include "PrivateCache.h"
+#include "TMOverflow.h"
 
 class TSXManager: public HTMManager {
 public:
@@ -35,7 +36,6 @@ protected:
     // Configurable member variables
     int             totalSize;
     int             assoc;
-    size_t          maxOverflowSize;
 
     // Statistics
     GStatsCntr      getSMsg;
@@ -48,7 +48,8 @@ protected:
 
     // State member variables
     std::vector<Cache*>         caches;
-    std::map<Pid_t, std::set<VAddr> >   overflow;
+    TMLineDirectory             directory;
+    TMOverflowSet               overflow;
 };
 
 #endif
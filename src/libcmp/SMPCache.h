@@ -261,6 +261,12 @@ public:
     void doInvalidate(PAddr addr, ushort size);
     void realInvalidate(PAddr addr, ushort size, bool writeBack);
 
+    // Fills would have to update the directory: only the replacement state
+    // of the lines already in the cache is warmed
+    void warm(PAddr addr, bool isWrite) {
+        cache->findLine(addr);
+    }
+
     // END MemObj interface
 
     // BEGIN protocol interface
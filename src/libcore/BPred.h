@@ -430,6 +430,15 @@ public:
         return p;
     }
 
+    // Train the tables with a branch run while fast-forwarding, without
+    // counting it in the statistics
+    void warm(const Instruction *inst, InstID oracleID) {
+        I(inst->isBranch());
+
+        if(ras.predict(inst, oracleID, true) == NoPrediction)
+            pred->predict(inst, oracleID, true);
+    }
+
     void dump(const char *str) const;
 
     void switchIn(Pid_t pid) {
@@ -94,6 +94,7 @@ FetchEngine::FetchEngine(int32_t cId
 #endif
     nGradInsts  = 0;
     nWPathInsts = 0;
+    nWarmFetched = 0;
 
     // Get some icache L1 parameters
     enableICache = SescConf->getBool("cpucore","enableICache", cId);
@@ -255,6 +256,8 @@ void FetchEngine::realFetch(IBucket *bucket, int32_t fetchMax)
         //osSim->stopSimulation();
     }
 
+    osSim->getSampler().fetched(totalnInst);
+
     if( totalnInst >= nInst2Sim ) {
         MSG("stopSimulation at %lld (%lld)",totalnInst, nInst2Sim);
         osSim->stopSimulation();
@@ -263,6 +266,23 @@ void FetchEngine::realFetch(IBucket *bucket, int32_t fetchMax)
     nFetched.add(tmp);
 }
 
+void FetchEngine::stalledFetch(Time_t n)
+{
+    I(isStalled());
+
+    // realFetch with executePC returning 0, without the empty bucket
+    ThreadContext::simDone = false;
+
+    nGradInsts += n;
+
+    osSim->getSampler().fetched(totalnInst);
+
+    if( totalnInst >= nInst2Sim ) {
+        MSG("stopSimulation at %lld (%lld)",totalnInst, nInst2Sim);
+        osSim->stopSimulation();
+    }
+}
+
 
 void FetchEngine::fetch(IBucket *bucket, int32_t fetchMax)
 {
@@ -337,6 +357,38 @@ void FetchEngine::dump(const char *str) const
     free(nstr);
 }
 
+///
+// Functional warm-up with an instruction run in rabbit mode
+// (ThreadContext::skipInsts): the branch predictor is trained, and the caches
+// see the data access and, like in fetch, one instruction access per fetch
+// block (FetchWidth instructions or up to a taken branch).
+void FetchEngine::warm(const Instruction *inst, InstID nextID, VAddr dAddr)
+{
+    GMemoryOS *memOS = gms->getMemoryOS();
+
+    if(enableICache && nWarmFetched == 0) {
+        int32_t iAddr = memOS->ITLBTranslate(inst->getAddr());
+        if(iAddr != -1)
+            gms->getInstrSource()->warm(iAddr, false);
+    }
+    nWarmFetched++;
+
+    if(inst->isBranch()) {
+        bpred->warm(inst, nextID);
+        if(nextID != inst->calcNextInstID())
+            nWarmFetched = 0;
+    }
+    if(nWarmFetched >= FetchWidth)
+        nWarmFetched = 0;
+
+    if(dAddr && (inst->isLoad() || inst->isStore())) {
+        // Pages missing in the TLB are not warmed
+        int32_t pAddr = memOS->TLBTranslate(dAddr);
+        if(pAddr != -1)
+            gms->getDataSource()->warm(pAddr, inst->isStore());
+    }
+}
+
 void FetchEngine::unBlockFetch()
 {
     I(missInstID);
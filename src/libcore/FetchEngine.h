@@ -73,6 +73,8 @@ private:
 #endif
     bool enableICache;
 
+    // Instructions in the current fetch block of warm()
+    ushort nWarmFetched;
 
 
 protected:
@@ -128,6 +130,8 @@ public:
         flow.goRabbitMode(n2Skip);
     }
 
+    void warm(const Instruction *inst, InstID nextID, VAddr dAddr);
+
     void unBlockFetch();
     StaticCallbackMember0<FetchEngine,&FetchEngine::unBlockFetch> unBlockFetchCB;
 
@@ -164,6 +168,17 @@ public:
         return pid >= 0;
     }
 
+    // A stalled engine would only fetch empty buckets
+    bool isStalled() const {
+        return missInstID == 0 && flow.isStalled();
+    }
+    Time_t getStallUntil() const {
+        return flow.getStallUntil();
+    }
+
+    // What realFetch does when the flow is stalled, for n cycles
+    void stalledFetch(Time_t n = 1);
+
     static void setnInst2Sim(long long a) {
         nInst2Sim = a;
     }
@@ -36,6 +36,8 @@ Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 #include "LDSTBuffer.h"
 
 
+bool GProcessor::skipIdle = false;
+
 GProcessor::GProcessor(GMemorySystem *gm, CPU_t i, size_t numFlows)
     :Id(i)
     ,FetchWidth(SescConf->getInt("cpucore", "fetchWidth",i))
@@ -444,6 +446,11 @@ void GProcessor::addEvent(EventType ev, CallbackBase *cb, int32_t vaddr)
     currentFlow()->addEvent(ev,cb,vaddr);
 }
 
+void GProcessor::warm(const Instruction *inst, InstID nextID, VAddr dAddr)
+{
+    currentFlow()->warm(inst, nextID, dAddr);
+}
+
 void GProcessor::retire()
 {
 #ifdef DEBUG
@@ -197,6 +197,10 @@ public:
 
     virtual void goRabbitMode(long long n2Skip) = 0;
 
+    // Functional warm-up with an instruction that ThreadContext::skipInsts
+    // ran, nextID is the instruction that followed it
+    void warm(const Instruction *inst, InstID nextID, VAddr dAddr);
+
     // Find a victim pid that can be switchout
     virtual Pid_t findVictimPid() const = 0;
 
@@ -204,6 +208,18 @@ public:
     // Processor.
     virtual void advanceClock() = 0;
 
+    // Skip the cycles where no processor can make progress (skipIdleCycles)
+    static bool skipIdle;
+
+    // First cycle when advanceClock can make progress. Until then,
+    // skipClock(n) has the same effect as calling advanceClock n times.
+    virtual Time_t getNextActiveClock() const {
+        return globalClock;
+    }
+    virtual void skipClock(Time_t nCycles) {
+        I(0);
+    }
+
     virtual bool hasWork() const=0;
 
 
@@ -178,6 +178,17 @@ public:
         return true;
     }
 
+    // Functional warm-up while fast-forwarding (ThreadContext::skipInsts):
+    // update the tags as if addr was accessed, without timing or
+    // statistics. Objects that do not implement it stop the warm-up there.
+    virtual void warm(PAddr addr, bool isWrite) {
+    }
+    // A peer cache warms addr, keep the coherence state consistent. Returns
+    // true if this object had the line.
+    virtual bool warmSnoop(PAddr addr, bool isWrite) {
+        return false;
+    }
+
     // Print stats
     virtual void dump() const;
 #if (defined SESC_CMP)
@@ -56,6 +56,11 @@ Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
 #include "libll/ThreadStats.h"
 #include "libll/ThreadContext.h"
+#include "libll/BBVProfile.h"
+#include "libll/TMTrace.h"
+#if (defined TM)
+#include "libTM/HTMManager.h"
+#endif
 #include "OSSim.h"
 
 OSSim   *osSim=0;
@@ -65,6 +70,7 @@ OSSim   *osSim=0;
  */
 
 char *OSSim::benchName=0;
+const int32_t OSSim::ChkVersion;
 
 static void sescConfSignal(int32_t sig)
 {
@@ -198,6 +204,8 @@ void OSSim::processParams(int32_t argc, char **argv, char **envp)
 
     nInst2Skip=0;
     nInst2Sim=0;
+    chkSaveName=0;
+    chkLoadName=0;
 
     bool useMTMarks = false;
     int32_t  mtId=0;
@@ -217,6 +225,8 @@ void OSSim::processParams(int32_t argc, char **argv, char **envp)
     if( argc < 2 ) {
         fprintf(stderr,"%s usage:\n",argv[0]);
         fprintf(stderr,"\t-cTEXT      ; Configuration file. Overrides sesc.conf and SESCCONF\n");
+        fprintf(stderr,"\t-csave:FILE ; Save a checkpoint to FILE after skipping (-w/-F)\n");
+        fprintf(stderr,"\t-cload:FILE ; Start from the checkpoint in FILE instead of skipping\n");
         fprintf(stderr,"\t-xTEXT      ; Extra key added in the report file name\n");
         fprintf(stderr,"\t-dTEXT      ; Change the name of the report file\n");
         fprintf(stderr,"\t-fTEXT      ; Fix the extension of the report file\n");
@@ -312,12 +322,19 @@ void OSSim::processParams(int32_t argc, char **argv, char **envp)
                 }
             }
             else if( argv[i][1] == 'c' ) {
+                const char *arg;
                 if( argv[i][2] != 0 )
-                    confName = &argv[i][2];
+                    arg = &argv[i][2];
                 else {
                     i++;
-                    confName = argv[i];
+                    arg = argv[i];
                 }
+                if( strncmp(arg, "save:", 5) == 0 )
+                    chkSaveName = arg + 5;
+                else if( strncmp(arg, "load:", 5) == 0 )
+                    chkLoadName = arg + 5;
+                else
+                    confName = arg;
             }
 
             else if( argv[i][1] == 'x' ) {
@@ -780,6 +797,37 @@ void OSSim::initBoot()
     else
         NoMigration = false;
 
+    // Basic block vectors of the skipped instructions (for SimPoint)
+    if(SescConf->checkInt("","bbvInterval")) {
+        SescConf->isGT("","bbvInterval",0);
+        char bbvName[1024];
+        if(SescConf->checkCharPtr("","bbvFile"))
+            snprintf(bbvName,sizeof(bbvName),"%s",SescConf->getCharPtr("","bbvFile"));
+        else
+            snprintf(bbvName,sizeof(bbvName),"%s.bb",benchName);
+        BBVProfile::active = new BBVProfile(bbvName,SescConf->getInt("","bbvInterval"));
+    }
+
+    // Binary trace of the transaction events (scripts/tmtrace2json.py)
+    if(SescConf->checkCharPtr("","tmTraceFile")) {
+        size_t ringSize = 4096;
+        if(SescConf->checkInt("","tmTraceRingSize")) {
+            SescConf->isGT("","tmTraceRingSize",0);
+            ringSize = SescConf->getInt("","tmTraceRingSize");
+        }
+        TMTrace::active = new TMTrace(SescConf->getCharPtr("","tmTraceFile"),ringSize);
+    }
+
+    // Jump over the cycles where all the processors are stalled
+    if(SescConf->checkBool("","skipIdleCycles"))
+        GProcessor::skipIdle = SescConf->getBool("","skipIdleCycles");
+
+    // Warm the caches and branch predictors while skipping
+    if(SescConf->checkBool("","warmFastForward"))
+        ThreadContext::warmSkip = SescConf->getBool("","warmFastForward");
+
+    sampler.boot();
+
     // this is only necessary when running execution-driven
 
     // Launch the boot flow
@@ -823,13 +871,61 @@ void OSSim::preBoot()
     }
 
     gettimeofday(&stTime, 0);
-    if(fastForward) {
+    long long nSkipped = 0;
+    if(chkLoadName) {
+        Report::field("OSSim:checkpoint=%s",chkLoadName);
+        loadCheckpoint(chkLoadName);
+    } else if(fastForward) {
         MSG("Begin fastforwarding: skipping instructions\n");
-        MSG("End skipping: skipped %lld\n",(long long int)ThreadContext::skipInsts(-1));
+        nSkipped = ThreadContext::skipInsts(-1);
+        MSG("End skipping: skipped %lld\n",nSkipped);
     } else {
         MSG("Begin skipping: requested %lld instructions\n",nInst2Skip);
-        MSG("End skipping: requested %lld skipped %lld\n",nInst2Skip,(long long int)ThreadContext::skipInsts(nInst2Skip));
+        nSkipped = ThreadContext::skipInsts(nInst2Skip);
+        MSG("End skipping: requested %lld skipped %lld\n",nInst2Skip,nSkipped);
     }
+    if(chkSaveName)
+        saveCheckpoint(chkSaveName);
+
+    if(BBVProfile::active)
+        MSG("Basic block vectors: %lld intervals",(long long)BBVProfile::active->getNumIntervals());
+    sampler.start(nSkipped);
+}
+
+void OSSim::saveCheckpoint(const char *fname)
+{
+    std::ofstream os(fname,std::ios::out|std::ios::binary);
+    if(!os) {
+        MSG("Can not create checkpoint file %s",fname);
+        exit(-1);
+    }
+    ChkWriter out(os.rdbuf());
+    out << "SescCheckpoint " << ChkVersion << endl;
+    out << "Bench " << benchName << endl;
+    ThreadContext::saveThreads(out);
+    os.close();
+    MSG("Checkpoint saved to %s\n",fname);
+}
+
+void OSSim::loadCheckpoint(const char *fname)
+{
+    std::ifstream is(fname,std::ios::in|std::ios::binary);
+    if(!is) {
+        MSG("Can not open checkpoint file %s",fname);
+        exit(-1);
+    }
+    ChkReader in(is.rdbuf());
+    int32_t version;
+    std::string bench;
+    in >> "SescCheckpoint " >> version >> endl;
+    in >> "Bench " >> bench >> endl;
+    if(version != ChkVersion || bench != benchName) {
+        MSG("Checkpoint %s is for %s (version %d), not for %s",fname,bench.c_str(),version,benchName);
+        exit(-1);
+    }
+    ThreadContext::restoreThreads(in);
+    is.close();
+    MSG("Checkpoint loaded from %s\n",fname);
 }
 
 void OSSim::postBoot()
@@ -865,6 +961,19 @@ void OSSim::simFinish()
 
     EventTrace::close();
 
+    if(BBVProfile::active) {
+        delete BBVProfile::active;
+        BBVProfile::active = 0;
+    }
+
+    if(TMTrace::active) {
+        MSG("TM trace: %llu events, %llu ring stalls",
+            (unsigned long long)TMTrace::active->getNumRecords(),
+            (unsigned long long)TMTrace::active->getNumStalls());
+        delete TMTrace::active;
+        TMTrace::active = 0;
+    }
+
     // hein? what is this? merge problems?
     //  if(trace())
     //  Report::close();
@@ -875,6 +984,10 @@ void OSSim::report(const char *str)
 
     ProcessId::report(str);
     ThreadStats::report(str);
+#if (defined TM)
+    if(htmManager)
+        htmManager->report(str);
+#endif
 
     for(size_t i=0; i<cpus.size(); i++) {
         GProcessor *gproc = cpus.getProcessor(i);
@@ -934,6 +1047,8 @@ void OSSim::report(const char *str)
     Report::field("EnergyMgr:totEnergy=%g",EnergyMgr::ptoe(totPower));
 #endif
 
+    sampler.report();
+
     // GStats must be the last to be called because previous ::report
     // can update statistics
     GStats::report(str);
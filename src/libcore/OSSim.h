@@ -44,6 +44,7 @@ Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
 #include "ProcessId.h"
 #include "RunningProcs.h"
+#include "Sampler.h"
 #include "libll/ThreadContext.h"
 
 void signalCatcher(int32_t sig);
@@ -57,6 +58,7 @@ class GProcessor;
 class OSSim {
 private:
     static char *benchName;
+    static const int32_t ChkVersion = 1;
     char *reportFile;
     char *traceFile;
 
@@ -76,10 +78,17 @@ private:
     // instructions. A cheap way to implement FastSimBegin
     long long nInst2Skip;
     long long nInst2Sim;
+    // Checkpoint written after skipping (-c save:FILE), or loaded instead of
+    // skipping (-c load:FILE)
+    const char *chkSaveName;
+    const char *chkLoadName;
     long long nInstCommited2Sim;
 
     unsigned long long snapshotGlobalClock;
 
+    // Periodic sampling (samplingPeriod in the configuration)
+    Sampler sampler;
+
     typedef struct {
         Pid_t pid;
         unsigned long total;
@@ -99,6 +108,8 @@ protected:
     StaticCallbackMember0<RunningProcs, &RunningProcs::finishWorkNow> finishWorkNowCB;
 
     void processParams(int32_t argc, char **argv, char **envp);
+    void saveCheckpoint(const char *fname);
+    void loadCheckpoint(const char *fname);
 
 public:
 	Time_t clockFreq;
@@ -330,6 +341,10 @@ public:
         return cpus.hasWork();
     }
 
+    Sampler &getSampler() {
+        return sampler;
+    }
+
     void pseudoReset() {
         snapshotGlobalClock = globalClock;
     }
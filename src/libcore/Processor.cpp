@@ -123,9 +123,14 @@ void Processor::advanceClock()
 
     // Fetch Stage
     if (IFID.hasWork() ) {
-        IBucket *bucket = pipeQ.pipeLine.newItem();
-        if( bucket ) {
-            IFID.fetch(bucket);
+        if (skipIdle && IFID.isStalled()) {
+            // Do not fill the pipeline with empty buckets
+            IFID.stalledFetch();
+        } else {
+            IBucket *bucket = pipeQ.pipeLine.newItem();
+            if( bucket ) {
+                IFID.fetch(bucket);
+            }
         }
     }
 
@@ -154,6 +159,35 @@ void Processor::advanceClock()
     retire();
 }
 
+Time_t Processor::getNextActiveClock() const
+{
+    if (!skipIdle || !IFID.hasWork() || !IFID.isStalled())
+        return globalClock;
+
+    // Something in flight
+    if (!ROB.empty() || pipeQ.hasWork())
+        return globalClock;
+
+    return IFID.getStallUntil() + 1;
+}
+
+void Processor::skipClock(Time_t nCycles)
+{
+    I(getNextActiveClock() >= globalClock + nCycles);
+
+    // What advanceClock does in a cycle with a stalled flow and an empty
+    // pipeline
+    clockTicks += nCycles;
+
+    IFID.stalledFetch(nCycles);
+
+    if (spaceInInstQueue >= FetchWidth)
+        noFetch2.add(nCycles);
+    else
+        noFetch.add(nCycles);
+
+    robUsed.msamples(0, nCycles);
+}
 
 StallCause Processor::addInst(DInst *dinst)
 {
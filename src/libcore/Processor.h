@@ -63,6 +63,9 @@ protected:
 
     void advanceClock();
 
+    Time_t getNextActiveClock() const;
+    void skipClock(Time_t nCycles);
+
     StallCause addInst(DInst *dinst);
 
     // END VIRTUAL FUNCTIONS of GProcessor
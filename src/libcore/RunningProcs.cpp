@@ -83,6 +83,49 @@ void RunningProcs::workingListAdd(GProcessor *core)
     workingList.push_back(core);
 }
 
+// Jumps globalClock to the next cycle where some processor can make
+// progress or some callback is scheduled. The skipped cycles are credited
+// to each processor (skipClock) as if advanceClock had been called.
+void RunningProcs::skipIdleClocks()
+{
+#if !(defined SESC_CMP) && !(defined DRAMSIM2)
+    // (The NOC and DRAMSim2 must be called every cycle)
+    if (!GProcessor::skipIdle)
+        return;
+
+    Time_t wakeUp = MaxTime;
+
+    for(size_t i=0; i < workingList.size(); i++) {
+        Time_t t = workingList[i]->getNextActiveClock();
+        if (t <= globalClock)
+            return;
+        if (t < wakeUp)
+            wakeUp = t;
+    }
+
+    Time_t t = EventScheduler::nextEventTime();
+    if (t < wakeUp)
+        wakeUp = t;
+
+    if (wakeUp <= globalClock || wakeUp >= MaxTime)
+        return;
+
+    // GStatsCntr are incremented with 32 bit values
+    Time_t nCycles = wakeUp - globalClock;
+    if (nCycles > 0x3FFFFFFF)
+        nCycles = 0x3FFFFFFF;
+
+    for(size_t i=0; i < workingList.size(); i++)
+        workingList[i]->skipClock(nCycles);
+
+    // Keep the same round-robin order as cycle by cycle
+    if (!workingList.empty())
+        startProc = (startProc + nCycles) % workingList.size();
+
+    EventScheduler::skipClock(globalClock + nCycles);
+#endif
+}
+
 void RunningProcs::run()
 {
     I(cpuVector.size() > 0 );
@@ -91,6 +134,7 @@ void RunningProcs::run()
 
     do {
         if ( workingList.empty() ) {
+            skipIdleClocks();
             EventScheduler::advanceClock();
         }
 
@@ -100,6 +144,8 @@ void RunningProcs::run()
             startProc = 0;
 
             do {
+                skipIdleClocks();
+
                 // Loop duplicated so round-robin fetch starts on different
                 // processor each cycle <><>
 
@@ -50,6 +50,8 @@ private:
 
     void workingListRemove(GProcessor *core);
     void workingListAdd(GProcessor *core);
+
+    void skipIdleClocks();
 public:
     void makeRunnable(ProcessId *proc);
     void makeNonRunnable(ProcessId *proc);
@@ -0,0 +1,300 @@
+/*
+   SESC: Super ESCalar simulator
+   Copyright (C) 2004 University of Illinois.
+
+This file is part of SESC.
+
+SESC is free software; you can redistribute it and/or modify it under the terms
+of the GNU General Public License as published by the Free Software Foundation;
+either version 2, or (at your option) any later version.
+
+SESC is    distributed in the  hope that  it will  be  useful, but  WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should  have received a copy of  the GNU General  Public License along with
+SESC; see the file COPYING.  If not, write to the  Free Software Foundation, 59
+Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+
+#include "SescConf.h"
+#include "ReportGen.h"
+#include "OSSim.h"
+#include "Sampler.h"
+#include "libll/ThreadContext.h"
+
+Sampler::Sampler()
+    : mode(NoSampling)
+    ,period(0)
+    ,warmup(0)
+    ,window(0)
+    ,phase(WarmupPhase)
+    ,phaseEnd(0)
+    ,nInstBefore(0)
+    ,nSkipped(0)
+    ,nextRegion(0)
+    ,commitStat(0)
+    ,abortStat(0)
+{
+}
+
+void Sampler::boot()
+{
+    warmup = SescConf->checkInt("","samplingWarmup") ? SescConf->getInt("","samplingWarmup") : 0;
+    if(warmup < 0) {
+        MSG("samplingWarmup (%lld) can not be negative",warmup);
+        exit(-1);
+    }
+
+    if(SescConf->checkCharPtr("","simpointFile"))
+        bootSimPoints(SescConf->getCharPtr("","simpointFile"),SescConf->getCharPtr("","simpointWeights"));
+    else if(SescConf->checkInt("","samplingPeriod"))
+        bootPeriodic();
+    else
+        return;
+
+    commitStat = GStats::getRef("tm:numCommits");
+    abortStat  = GStats::getRef("tm:numAborts");
+}
+
+void Sampler::bootPeriodic()
+{
+    mode   = PeriodicMode;
+    period = SescConf->getInt("","samplingPeriod");
+    window = SescConf->getInt("","samplingWindow");
+
+    SescConf->isGT("","samplingPeriod",0);
+    SescConf->isGT("","samplingWindow",0);
+    if(warmup + window > period) {
+        MSG("samplingWarmup (%lld) + samplingWindow (%lld) must be in samplingPeriod (%lld)",warmup,window,period);
+        exit(-1);
+    }
+
+    MSG("Sampling: period %lld warmup %lld window %lld instructions",period,warmup,window);
+}
+
+///
+// Read the SimPoint output: the simpoints file has "interval cluster" lines,
+// and the weights file "weight cluster" lines.
+void Sampler::bootSimPoints(const char *simpointFile, const char *weightFile)
+{
+    mode   = SimPointMode;
+    window = SescConf->getInt("","simpointInterval");
+    SescConf->isGT("","simpointInterval",0);
+
+    std::map<int32_t,double> weights;
+    FILE *fp = fopen(weightFile,"r");
+    if(!fp) {
+        MSG("Can not open SimPoint weights file %s",weightFile);
+        exit(-1);
+    }
+    double weight;
+    int32_t cluster;
+    while(fscanf(fp,"%lf %d",&weight,&cluster) == 2)
+        weights[cluster] = weight;
+    fclose(fp);
+
+    fp = fopen(simpointFile,"r");
+    if(!fp) {
+        MSG("Can not open SimPoint file %s",simpointFile);
+        exit(-1);
+    }
+    long long interval;
+    while(fscanf(fp,"%lld %d",&interval,&cluster) == 2) {
+        if(!weights.count(cluster)) {
+            MSG("SimPoint cluster %d of interval %lld has no weight in %s",cluster,interval,weightFile);
+            exit(-1);
+        }
+        Region r;
+        r.start  = interval * window;
+        r.weight = weights[cluster];
+        regions.push_back(r);
+    }
+    fclose(fp);
+
+    if(regions.empty()) {
+        MSG("No SimPoints in %s",simpointFile);
+        exit(-1);
+    }
+    std::sort(regions.begin(), regions.end());
+
+    MSG("Sampling: %lu SimPoints of %lld instructions, warmup %lld",regions.size(),window,warmup);
+    MSG("Sampling: only the Sampling: report fields are weighted, the other statistics are not");
+}
+
+void Sampler::start(long long nInst)
+{
+    nInstBefore = nInst;
+    if(mode == PeriodicMode)
+        beginWarmup(0, warmup);
+    else if(mode == SimPointMode)
+        skipToRegion(0);
+}
+
+void Sampler::getCounters(Sample &s, long long totalnInst) const
+{
+    s.nInst    = totalnInst;
+    s.nCycles  = globalClock;
+    s.nCommits = commitStat ? (long long)commitStat->getDouble() : 0;
+    s.nAborts  = abortStat ? (long long)abortStat->getDouble() : 0;
+    s.weight   = 1;
+}
+
+///
+// Simulate len detailed instructions before the measured window
+void Sampler::beginWarmup(long long totalnInst, long long len)
+{
+    if(len > 0) {
+        phase    = WarmupPhase;
+        phaseEnd = totalnInst + len;
+    } else {
+        getCounters(windowStart, totalnInst);
+        phase    = MeasurePhase;
+        phaseEnd = totalnInst + window;
+    }
+}
+
+///
+// Fast-forward up to warmup instructions before the next region. Regions
+// closer than that to the end of the previous one get a shorter warm-up.
+void Sampler::skipToRegion(long long totalnInst)
+{
+    const Region &r = regions[nextRegion];
+    long long pos = getPosition(totalnInst);
+    if(r.start - warmup > pos && !ThreadContext::simDone) {
+        nSkipped += ThreadContext::skipInsts(r.start - warmup - pos);
+        pos = getPosition(totalnInst);
+    }
+    beginWarmup(totalnInst, r.start - pos);
+}
+
+void Sampler::nextPhase(long long totalnInst)
+{
+    if(phase == DonePhase)
+        return;
+    if(phase == WarmupPhase) {
+        beginWarmup(totalnInst, 0);
+        return;
+    }
+
+    Sample end;
+    getCounters(end, totalnInst);
+    Sample s;
+    s.nInst    = end.nInst - windowStart.nInst;
+    s.nCycles  = end.nCycles - windowStart.nCycles;
+    s.nCommits = end.nCommits - windowStart.nCommits;
+    s.nAborts  = end.nAborts - windowStart.nAborts;
+    s.weight   = 1;
+
+    // The fetch engines overshoot the window by up to FetchWidth
+    // instructions, the skip does not compensate it.
+    if(mode == PeriodicMode) {
+        samples.push_back(s);
+        if(!ThreadContext::simDone)
+            nSkipped += ThreadContext::skipInsts(period - warmup - window);
+        beginWarmup(totalnInst, warmup);
+        return;
+    }
+
+    s.weight = regions[nextRegion].weight;
+    samples.push_back(s);
+    nextRegion++;
+    if(nextRegion < regions.size()) {
+        skipToRegion(totalnInst);
+    } else {
+        MSG("Sampling: last SimPoint done at %lld instructions",getPosition(totalnInst));
+        phase = DonePhase;
+        osSim->stopSimulation();
+    }
+}
+
+///
+// Report mean, standard deviation and 95% confidence interval of vals
+void Sampler::reportInterval(const char *name, const std::vector<double> &vals)
+{
+    size_t n = vals.size();
+    double sum = 0;
+    for(size_t i = 0; i < n; i++)
+        sum += vals[i];
+    double mean = sum / n;
+
+    double var = 0;
+    for(size_t i = 0; i < n; i++)
+        var += (vals[i] - mean) * (vals[i] - mean);
+    double stdDev = n > 1 ? sqrt(var / (n - 1)) : 0;
+    double ci     = n > 1 ? 1.96 * stdDev / sqrt((double)n) : 0;
+
+    Report::field("Sampling:%s=%g:stdDev=%g:ci95=%g:relErr=%g"
+                  ,name, mean, stdDev, ci, mean ? ci / mean : 0);
+}
+
+///
+// Report the weighted mean of vals (the weights of the simulated samples are
+// normalized to add up to 1)
+void Sampler::reportWeighted(const char *name, const std::vector<double> &vals, const std::vector<double> &weights)
+{
+    double sum  = 0;
+    double wSum = 0;
+    for(size_t i = 0; i < vals.size(); i++) {
+        sum  += weights[i] * vals[i];
+        wSum += weights[i];
+    }
+    Report::field("Sampling:%s=%g:weight=%g", name, wSum ? sum / wSum : 0, wSum);
+}
+
+void Sampler::report() const
+{
+    if(mode == NoSampling)
+        return;
+
+    if(mode == PeriodicMode)
+        Report::field("Sampling:period=%lld:warmup=%lld:window=%lld",period,warmup,window);
+    else
+        Report::field("Sampling:simpoints=%lu:warmup=%lld:window=%lld",regions.size(),warmup,window);
+    Report::field("Sampling:nSamples=%lu:nSkipped=%lld",samples.size(),nSkipped);
+    // Only the Sampling: fields account for the sampling. Everything else in
+    // the report (GStats included) adds up the detailed windows as they ran.
+    if(mode == PeriodicMode)
+        Report::field("Sampling:warning=statistics outside Sampling: are the sum of the detailed windows including warm-up");
+    else
+        Report::field("Sampling:warning=statistics outside Sampling: are NOT weighted, they are the sum of the SimPoint windows including warm-up");
+    if(samples.empty())
+        return;
+
+    std::vector<double> ipc;
+    std::vector<double> cpi;
+    std::vector<double> commitRate;
+    std::vector<double> abortRate;
+    std::vector<double> weights;
+    for(size_t i = 0; i < samples.size(); i++) {
+        const Sample &s = samples[i];
+        Report::field("Sample(%lu):nInst=%lld:nCycles=%lld:nCommits=%lld:nAborts=%lld:weight=%g"
+                      ,i, s.nInst, (long long)s.nCycles, s.nCommits, s.nAborts, s.weight);
+        ipc.push_back(s.nCycles ? (double)s.nInst / s.nCycles : 0);
+        cpi.push_back(s.nInst ? (double)s.nCycles / s.nInst : 0);
+        // Per thousand instructions
+        commitRate.push_back(1000.0 * s.nCommits / s.nInst);
+        abortRate.push_back(1000.0 * s.nAborts / s.nInst);
+        weights.push_back(s.weight);
+    }
+
+    if(mode == PeriodicMode) {
+        reportInterval("IPC", ipc);
+        if(commitStat) {
+            reportInterval("commitsPKI", commitRate);
+            reportInterval("abortsPKI", abortRate);
+        }
+    } else {
+        // Weighted CPI (not IPC) is what adds up over the intervals
+        reportWeighted("CPI", cpi, weights);
+        if(commitStat) {
+            reportWeighted("commitsPKI", commitRate, weights);
+            reportWeighted("abortsPKI", abortRate, weights);
+        }
+    }
+}
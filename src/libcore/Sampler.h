@@ -0,0 +1,133 @@
+/*
+   SESC: Super ESCalar simulator
+   Copyright (C) 2004 University of Illinois.
+
+This file is part of SESC.
+
+SESC is free software; you can redistribute it and/or modify it under the terms
+of the GNU General Public License as published by the Free Software Foundation;
+either version 2, or (at your option) any later version.
+
+SESC is    distributed in the  hope that  it will  be  useful, but  WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should  have received a copy of  the GNU General  Public License along with
+SESC; see the file COPYING.  If not, write to the  Free Software Foundation, 59
+Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+#ifndef _SAMPLER_H
+#define _SAMPLER_H
+
+#include <vector>
+
+#include "callback.h"
+#include "GStats.h"
+
+///
+// Sampled simulation. The simulator alternates detailed windows with
+// fast-forwarding (ThreadContext::skipInsts). Before each measured window
+// there is a detailed warm-up (samplingWarmup instructions) to warm up the
+// pipelines and caches. Each measured window is a sample. There are two
+// modes:
+//
+// Periodic (samplingPeriod in the configuration, SMARTS-like): every
+// samplingPeriod instructions there is a measured window of samplingWindow
+// instructions. The report has the mean and confidence interval of the IPC
+// and of the TM commit and abort rates.
+//
+// SimPoint (simpointFile and simpointWeights): only the intervals listed in
+// the SimPoint output are simulated (simpointInterval instructions each, the
+// interval size used to profile the BBVs). The report has the weighted IPC and
+// TM commit and abort rates.
+//
+// The instruction counts are the ones seen by FetchEngine (all the cores
+// together) plus the skipped ones.
+class Sampler {
+private:
+    enum Mode {
+        NoSampling,
+        PeriodicMode,
+        SimPointMode
+    };
+    enum Phase {
+        WarmupPhase,
+        MeasurePhase,
+        DonePhase
+    };
+
+    struct Sample {
+        long long nInst;
+        Time_t    nCycles;
+        long long nCommits;
+        long long nAborts;
+        double    weight;
+    };
+    struct Region {
+        long long start;
+        double    weight;
+        bool operator<(const Region &other) const {
+            return start < other.start;
+        }
+    };
+
+    Mode      mode;
+    long long period;
+    long long warmup;
+    long long window;
+
+    Phase     phase;
+    // Detailed instruction count (FetchEngine::totalnInst) that ends the phase
+    long long phaseEnd;
+    // Instructions skipped before the detailed simulation started (-w)
+    long long nInstBefore;
+    long long nSkipped;
+
+    std::vector<Region> regions;
+    size_t    nextRegion;
+
+    // Counters when the current measurement window started
+    Sample    windowStart;
+
+    std::vector<Sample> samples;
+
+    // TM statistics, 0 if there is no TM manager
+    const GStats *commitStat;
+    const GStats *abortStat;
+
+    void bootPeriodic();
+    void bootSimPoints(const char *simpointFile, const char *weightFile);
+
+    long long getPosition(long long totalnInst) const {
+        return nInstBefore + nSkipped + totalnInst;
+    }
+    void getCounters(Sample &s, long long totalnInst) const;
+    void beginWarmup(long long totalnInst, long long len);
+    void skipToRegion(long long totalnInst);
+    void nextPhase(long long totalnInst);
+
+    static void reportInterval(const char *name, const std::vector<double> &vals);
+    static void reportWeighted(const char *name, const std::vector<double> &vals, const std::vector<double> &weights);
+
+public:
+    Sampler();
+
+    void boot();
+    // Detailed simulation starts after skipping nInst instructions
+    void start(long long nInst);
+
+    bool isActive() const {
+        return mode != NoSampling;
+    }
+
+    // Called by the FetchEngine each time the count of detailed instructions
+    // grows
+    void fetched(long long totalnInst) {
+        if(mode != NoSampling && totalnInst >= phaseEnd)
+            nextPhase(totalnInst);
+    }
+
+    void report() const;
+};
+
+#endif
@@ -55,6 +55,7 @@ public:
     static const Tint VENOSYS = 0x00000059;
     static const Tint VELOOP = 0x0000005a;
     static const Tint VEAFNOSUPPORT = 0x0000007c;
+    static const Tint VETIMEDOUT = 0x00000091;
     static const Tint VSIGHUP = 0x00000001;
     static const Tint VSIGINT = 0x00000002;
     static const Tint VSIGQUIT = 0x00000003;
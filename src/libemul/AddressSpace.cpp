@@ -3,6 +3,7 @@
 #include "nanassert.h"
 
 #include <cstring>
+#include <algorithm>
 
 namespace MemSys {
 
@@ -28,7 +29,7 @@ void FrameDesc::sync(void) {
         dirty=false;
     }
 }
-FrameDesc::FrameDesc() : GCObject(), basePAddr(newPAddr()), shared(false), dirty(false), fileDesc(0) {
+FrameDesc::FrameDesc() : GCObject(), basePAddr(newPAddr()), shared(false), dirty(false), fileDesc(0), data(newData()), hostMapped(false) {
     memset(data,0,AddrSpacPageSize);
 }
 FrameDesc::FrameDesc(FileSys::SeekableDescription *fdesc, off_t offs)
@@ -40,7 +41,14 @@ FrameDesc::FrameDesc(FileSys::SeekableDescription *fdesc, off_t offs)
     , fileOff(offs) {
     if(offs%AddrSpacPageSize)
         fail("FrameDesc file mapping offset is not page-aligned\n");
-    fileDesc->mmap(data,AddrSpacPageSize,fileOff);
+    // Use a host mapping of the page if possible (no copy, the host faults
+    // the page in on first access), otherwise read the page in
+    data=static_cast<MemAlignType *>(fileDesc->mapHost(AddrSpacPageSize,fileOff,this));
+    hostMapped=(data!=0);
+    if(!hostMapped) {
+        data=newData();
+        fileDesc->mmap(data,AddrSpacPageSize,fileOff);
+    }
 #if (defined HAS_MEM_STATE)
     for(size_t s=0; s<AddrSpacPageSize/MemState::Granularity; s++)
         state[s]=src.state[s];
@@ -51,6 +59,8 @@ FrameDesc::FrameDesc(FrameDesc &src)
     ,basePAddr(newPAddr())
     ,shared(false)
     ,dirty(false)
+    ,data(newData())
+    ,hostMapped(false)
 {
     memcpy(data,src.data,AddrSpacPageSize);
 #if (defined HAS_MEM_STATE)
@@ -64,7 +74,19 @@ FrameDesc::~FrameDesc() {
         fileToFrame.erase(FileMapKey(fileDesc,fileOff));
     I(freePAddrs.find(basePAddr)==freePAddrs.end());
     freePAddrs.insert(basePAddr);
-    memset(data,0xCC,AddrSpacPageSize);
+    if(hostMapped) {
+        fileDesc->unmapHost(data,AddrSpacPageSize,this);
+    } else {
+        memset(data,0xCC,AddrSpacPageSize);
+        delete [] data;
+    }
+}
+void FrameDesc::detachHost(void) {
+    I(hostMapped);
+    MemAlignType *copy=newData();
+    memcpy(copy,data,AddrSpacPageSize);
+    data=copy;
+    hostMapped=false;
 }
 void FrameDesc::save(ChkWriter &out) const {
     out.write(reinterpret_cast<const char *>(data),AddrSpacPageSize);
@@ -74,7 +96,7 @@ void FrameDesc::save(ChkWriter &out) const {
 #endif
     out<<endl;
 }
-FrameDesc::FrameDesc(ChkReader &in) {
+FrameDesc::FrameDesc(ChkReader &in) : data(newData()), hostMapped(false) {
     in.read(reinterpret_cast<char *>(data),AddrSpacPageSize);
 #if (defined HAS_MEM_STATE)
     for(size_t s=0; s<AddrSpacPageSize/MemState::Granularity; s++)
@@ -85,47 +107,80 @@ FrameDesc::FrameDesc(ChkReader &in) {
 
 }
 
-AddressSpace::PageTable::Cache::Cache(void) {
-    for(size_t i=0; i<AddrSpaceCacheSize; i++)
-        cache[i].pageNum=0;
-}
-void AddressSpace::PageTable::Cache::unmap(PageNum pageNumLb, PageNum pageNumUb) {
-    if(AddrSpaceCacheSize<(pageNumUb-pageNumLb)) {
-        for(size_t i=0; i<AddrSpaceCacheSize; i++) {
-            if((cache[i].pageNum>=pageNumLb)&&(cache[i].pageNum<pageNumUb))
-                cache[i].pageNum=0;
-        }
-    } else {
-        for(PageNum pageNum=pageNumLb; pageNum<pageNumUb; pageNum++) {
-            Entry &entry=cache[pageNum%AddrSpaceCacheSize];
-            if(entry.pageNum==pageNum)
-                entry.pageNum=0;
-        }
-    }
-}
 AddressSpace::PageTable::PageTable(void)
-    : pageMap(), cache() {
+    : pageMap() {
+    for(PageNum i=0; i<RootSize; i++)
+        root[i]=0;
 }
 AddressSpace::PageTable::PageTable(PageTable &src)
-    : pageMap(), cache() {
+    : pageMap() {
+    for(PageNum i=0; i<RootSize; i++)
+        root[i]=0;
+    // Only the leaves that exist in src are visited, and only mapped pages copied
+    for(PageNum i=0; i<RootSize; i++) {
+        if(!src.root[i])
+            continue;
+        for(PageNum j=0; j<LeafSize; j++) {
+            PageDesc &srcPage=src.root[i][j];
+            if(srcPage.getFrame())
+                (*this)[(i<<LeafBits)+j]=srcPage;
+        }
+    }
     for(PageMap::iterator it=src.pageMap.begin(); it!=src.pageMap.end(); it++)
-        pageMap[it->first]=it->second;
+        if(it->second.getFrame())
+            pageMap[it->first]=it->second;
+}
+AddressSpace::PageTable::~PageTable(void) {
+    for(PageNum i=0; i<RootSize; i++)
+        delete [] root[i];
+}
+AddressSpace::PageDesc *AddressSpace::PageTable::newLeaf(PageNum rootIdx) {
+    I(!root[rootIdx]);
+    root[rootIdx]=new PageDesc[LeafSize];
+    return root[rootIdx];
 }
 void AddressSpace::PageTable::map(PageNum pageNumLb, PageNum pageNumUb,
                                   bool r, bool w, bool x, bool s,
                                   FileSys::SeekableDescription *fdesc, off_t offs) {
     for(PageNum pageNum=pageNumLb; pageNum<pageNumUb; pageNum++) {
-        I(pageMap.find(pageNum)==pageMap.end());
-        pageMap[pageNum].map(r,w,x,s,fdesc,offs+AddrSpacPageSize*(pageNum-pageNumLb));
+        I(!isMapped(pageNum));
+        (*this)[pageNum].map(r,w,x,s,fdesc,offs+AddrSpacPageSize*(pageNum-pageNumLb));
+    }
+}
+void AddressSpace::PageTable::unmapInsts(VAddr addrLb, VAddr addrUb) {
+    for(PageNum pageNum=getPageNumLb(addrLb); pageNum<getPageNumUb(addrUb); pageNum++) {
+        PageDesc *page=0;
+        if(pageNum<RadixPages) {
+            if(root[pageNum>>LeafBits])
+                page=&root[pageNum>>LeafBits][pageNum&(LeafSize-1)];
+        } else {
+            PageMap::iterator it=pageMap.find(pageNum);
+            if(it!=pageMap.end())
+                page=&(it->second);
+        }
+        if(!page)
+            continue;
+        // Slots of the instructions in [addrLb,addrUb) within this page
+        VAddr pageAddr=((VAddr)pageNum)<<AddrSpacPageOffsBits;
+        VAddr lb=(addrLb>pageAddr)?addrLb:pageAddr;
+        VAddr ub=(addrUb<pageAddr+AddrSpacPageSize)?addrUb:(pageAddr+AddrSpacPageSize);
+        page->unmapInsts((lb-pageAddr+sizeof(uint32_t)-1)/sizeof(uint32_t),
+                         (ub-pageAddr+sizeof(uint32_t)-1)/sizeof(uint32_t));
     }
 }
 void AddressSpace::PageTable::unmap(PageNum pageNumLb, PageNum pageNumUb) {
+    for(PageNum pageNum=pageNumLb; (pageNum<pageNumUb)&&(pageNum<RadixPages); pageNum++) {
+        PageDesc *leaf=root[pageNum>>LeafBits];
+        if(!leaf) {
+            // Skip to the start of the next leaf
+            pageNum|=(LeafSize-1);
+            continue;
+        }
+        leaf[pageNum&(LeafSize-1)].unmap();
+    }
     pageMap.erase(pageMap.lower_bound(pageNumLb),pageMap.lower_bound(pageNumUb));
-    cache.unmap(pageNumLb,pageNumUb);
 }
 
-AddressSpace::FrameTable AddressSpace::frameTable;
-
 void AddressSpace::SegmentDesc::save(ChkWriter &out) const {
     out << "Addr " << addr << " Len " << len;
     out << "R" << canRead;
@@ -154,6 +209,7 @@ ChkReader &AddressSpace::SegmentDesc::operator=(ChkReader &in) {
 
 AddressSpace::PageDesc::PageDesc(void)
     : flags(static_cast<Flags>(0)),
+      insts(0),
       frame(0) {
 }
 AddressSpace::PageDesc::PageDesc(PageDesc &src) {
@@ -161,31 +217,43 @@ AddressSpace::PageDesc::PageDesc(PageDesc &src) {
 }
 AddressSpace::PageDesc::PageDesc(const PageDesc &src)
     : flags(src.flags),
+      insts(0),
       frame(src.frame)
 {
     if(frame||flags)
         fail("Const copy constructor called!\n");
 }
 AddressSpace::PageDesc::~PageDesc(void) {
-    if(frame)
-        frameTable.erase(FrameTableEntry(frame,this));
+    delete [] insts;
+}
+void AddressSpace::PageDesc::unmap(void) {
+    frame=0;
+    flags=static_cast<Flags>(0);
+    delete [] insts;
+    insts=0;
+}
+void AddressSpace::PageDesc::mapInst(VAddr addr, InstDesc *inst) {
+    I(!(addr&(sizeof(uint32_t)-1)));
+    if(!insts) {
+        insts=new InstDesc *[InstSlots];
+        std::fill(insts,insts+InstSlots,(InstDesc *)0);
+    }
+    size_t slot=(addr&AddrSpacPageOffsMask)/sizeof(uint32_t);
+    I(!insts[slot]);
+    insts[slot]=inst;
+}
+void AddressSpace::PageDesc::unmapInsts(size_t slotLb, size_t slotUb) {
+    I(slotUb<=InstSlots);
+    if(insts)
+        std::fill(insts+slotLb,insts+slotUb,(InstDesc *)0);
 }
 void AddressSpace::PageDesc::copyFrame(void) {
-//  if(frame->getRefCount()<=1)
-//    fail("Copying uniquely-mapped frame\n");
-    frameTable.erase(FrameTableEntry(frame,this));
     frame=new MemSys::FrameDesc(*frame);
-    frameTable.insert(FrameTableEntry(frame,this));
 }
 void AddressSpace::PageDesc::doWrCopy(void) {
     flags=static_cast<Flags>(flags&~WrCopy);
-    if(frame->isShared())
-        return copyFrame();
-    FrameTable::iterator it=frameTable.lower_bound(FrameTableEntry(frame,0));
-    if(it->page!=this)
-        return copyFrame();
-    it++;
-    if((it!=frameTable.end())&&(it->frame==frame))
+    // A private page gets its own copy unless it is the only mapping of the frame
+    if(frame->isShared()||!frame->isUniquelyMapped())
         return copyFrame();
 }
 //AddressSpace::PageDesc::PageDesc &AddressSpace::PageDesc::operator=(PageDesc &src){
@@ -196,16 +264,11 @@ AddressSpace::PageDesc &AddressSpace::PageDesc::operator=(PageDesc &src) {
     frame=src.frame;
     if(!frame)
         fail("PageDesc::operator= src has no frame!\n");
-    if(frame)
-        frameTable.insert(FrameTableEntry(frame,this));
+    // Every private page whose frame has other mappings has WrCopy set, so
+    // only the source and the new mapping need it here
     if(!(flags&Shared)) {
-        FrameTable::iterator it=frameTable.lower_bound(FrameTableEntry(frame,0));
-        while((it!=frameTable.end())&&(it->frame==frame)) {
-            PageDesc *pg=it->page;
-            if(!(pg->flags&Shared))
-                pg->flags=static_cast<Flags>(pg->flags|WrCopy);
-            it++;
-        }
+        flags=static_cast<Flags>(flags|WrCopy);
+        src.flags=static_cast<Flags>(src.flags|WrCopy);
     }
     return *this;
 }
@@ -223,33 +286,6 @@ ChkReader &AddressSpace::PageDesc::operator=(ChkReader &in) {
     return in;
 }
 
-AddressSpace::InstTable::Cache::Cache(void) {
-    for(size_t i=0; i<AddrSpaceCacheSize; i++)
-        cache[i].instAddr=0;
-}
-void AddressSpace::InstTable::Cache::unmap(VAddr instAddrLb, VAddr instAddrUb) {
-    if(AddrSpaceCacheSize<(instAddrUb-instAddrLb)) {
-        for(size_t i=0; i<AddrSpaceCacheSize; i++) {
-            if((cache[i].instAddr>=instAddrLb)&&(cache[i].instAddr<instAddrUb))
-                cache[i].instAddr=0;
-        }
-    } else {
-        for(VAddr instAddr=instAddrLb; instAddr<instAddrUb; instAddr++) {
-            Entry &entry=cache[instAddr%AddrSpaceCacheSize];
-            if(entry.instAddr==instAddr)
-                entry.instAddr=0;
-        }
-    }
-}
-AddressSpace::InstTable::InstTable(void)
-    : instMap(), cache() {
-}
-void AddressSpace::InstTable::unmap(VAddr instAddrLb, VAddr instAddrUb) {
-    InstMap::iterator instItLb=instMap.lower_bound(instAddrLb);
-    InstMap::iterator instItUb=instMap.lower_bound(instAddrUb);
-    instMap.erase(instItLb,instItUb);
-    cache.unmap(instAddrLb,instAddrUb);
-}
 void AddressSpace::createTrace(ThreadContext *context, VAddr addr) {
     VAddr segAddr=getSegmentAddr(addr);
     VAddr segSize=getSegmentSize(segAddr);
@@ -296,7 +332,7 @@ void AddressSpace::delInsts(VAddr begAddr, VAddr endAddr) {
     traceMap.erase(trcItLb,trcItUb);
     // TODO: Check if any thread is pointing to one of these insts (should never happen, but we should check)
     // Delete mapped instructions from traces we erased
-    instTable.unmap(begAddr,endAddr);
+    pageTable.unmapInsts(begAddr,endAddr);
 }
 
 AddressSpace::AddressSpace(void) :
@@ -322,62 +358,91 @@ AddressSpace::~AddressSpace(void) {
 
 void AddressSpace::save(ChkWriter &out) const {
     out << "BrkBase " << brkBase <<endl;
-    // Page dump, dumps only pages that have any physical mapping
-//   for(size_t _pageNum=0;_pageNum<AddrSpacPageNumCount;_pageNum++){
-//     if(!pageMap[_pageNum].frame)
-//       continue;
-//     out << _pageNum << " ";
-//     pageMap[_pageNum].save(out);
-//   }
-//   // Page number zero signals end of page dump
-//   out << 0 << endl;
     // Segment dump
     out << "Segments " << segmentMap.size() << endl;
-    for(SegmentMap::const_iterator segIt=segmentMap.begin(); segIt!=segmentMap.end(); segIt++)
+    for(SegmentMap::const_iterator segIt=segmentMap.begin(); segIt!=segmentMap.end(); segIt++) {
+        if(segIt->second.fileDesc)
+            fail("AddressSpace::save shared file mappings can not be saved\n");
         segIt->second.save(out);
-    // Dump function name mappings
-//   out << "FuncNames " << funcAddrToName.size() << endl;
-//   for(AddrToNameMap::const_iterator addrIt=funcAddrToName.begin();
-//       addrIt!=funcAddrToName.end();addrIt++){
-//     const std::string &file=getFuncFile(addrIt->first);
-//     I(file!="");
-//     out << addrIt->first <<
-//            " -> " << strlen(addrIt->second) << " " << addrIt->second <<
-//       " : " << file.length() << " " << file << endl;
-//   }
+    }
+    // Page dump, dumps only pages that are not all-zero (new frames are zeroed)
+    uint8_t buf[AddrSpacPageSize];
+    static const uint8_t zeroPage[AddrSpacPageSize]= {0};
+    for(SegmentMap::const_iterator segIt=segmentMap.begin(); segIt!=segmentMap.end(); segIt++) {
+        const SegmentDesc &seg=segIt->second;
+        for(size_t _pageNum=seg.pageNumLb(); _pageNum<seg.pageNumUb(); _pageNum++) {
+            if(!pageTable.isMapped(_pageNum))
+                continue;
+            pageTable[_pageNum].getFrame()->readBlock((VAddr)(_pageNum<<AddrSpacPageOffsBits),buf,AddrSpacPageSize);
+            if(!memcmp(buf,zeroPage,AddrSpacPageSize))
+                continue;
+            out << "Page " << _pageNum << endl;
+            out.write(reinterpret_cast<const char *>(buf),AddrSpacPageSize);
+            out << endl;
+        }
+    }
+    // Page number zero signals end of page dump
+    out << "Page " << 0 << endl;
+    // Function names are not saved, they come from the executable
 }
 
-AddressSpace::AddressSpace(ChkReader &in) {
-    in >> "BrkBase " >> brkBase >> endl;
-    while(true) {
-        size_t _pageNum;
-        in >> _pageNum;
-        if(!_pageNum)
-            break;
-        in >> " ";
-        pageTable[_pageNum]=in;
+AddressSpace::AddressSpace(ChkReader &in) :
+    GCObject(),
+    brkBase(0)
+{
+    restore(in);
+}
+
+void AddressSpace::restore(ChkReader &in) {
+    // Drop the current segments and pages. Function names are kept, so this is
+    // meant to be used on an address space created from the same executable.
+    for(SegmentMap::iterator segIt=segmentMap.begin(); segIt!=segmentMap.end(); segIt++) {
+        SegmentDesc &seg=segIt->second;
+        delInsts(seg.addr,seg.addr+seg.len);
+        pageTable.unmap(seg.pageNumLb(),seg.pageNumUb());
     }
-    in >> endl;
+    segmentMap.clear();
+    in >> "BrkBase " >> brkBase >> endl;
     size_t _segCount;
     in >> "Segments " >> _segCount >> endl;
     for(size_t i=0; i<_segCount; i++) {
         SegmentDesc seg;
         seg=in;
-        newSegment(seg.addr,seg.len,seg.canRead,seg.canWrite,seg.canExec,seg.shared,seg.fileDesc,seg.fileOffset);
+        newSegment(seg.addr,seg.len,seg.canRead,seg.canWrite,seg.canExec,seg.shared,0,0);
         setGrowth(seg.addr,seg.autoGrow,seg.growDown);
     }
-    // Load function name mappings
-//   size_t _funcAddrToName;
-//   in >> "FuncNames " >> _funcAddrToName >> endl;
-//   for(size_t i=0;i<_funcAddrToName;i++){
-//     VAddr _addr; size_t _strlen;
-//     in >> _addr >> " -> " >> _strlen >> " ";
-//     char func[_strlen+1];
-//     in >> func >> " : " >> _strlen >> " ";
-//     char file[_strlen+1];
-//     in >> file >> endl;
-//     addFuncName(_addr,func,file);
-//   }
+    uint8_t buf[AddrSpacPageSize];
+    while(true) {
+        size_t _pageNum;
+        in >> "Page " >> _pageNum >> endl;
+        if(!_pageNum)
+            break;
+        in.read(reinterpret_cast<char *>(buf),AddrSpacPageSize);
+        in >> endl;
+        if(!pageTable.isMapped(_pageNum))
+            fail("AddressSpace::restore page 0x%lx is not in any segment\n",(unsigned long)_pageNum);
+        pageTable[_pageNum].getFrame()->writeBlock((VAddr)(_pageNum<<AddrSpacPageOffsBits),buf,AddrSpacPageSize);
+    }
+}
+
+void AddressSpace::getHostIov(VAddr addr, size_t len, bool forWrite, std::vector<struct iovec> &iov) {
+    while(len) {
+        size_t pageLen=AddrSpacPageSize-getPageOff(addr);
+        if(pageLen>len)
+            pageLen=len;
+        PageDesc &myPage=getPage(addr);
+        int8_t *ptr=forWrite?myPage.getWrData(addr):myPage.getRdData(addr);
+        if((!iov.empty())&&(static_cast<int8_t *>(iov.back().iov_base)+iov.back().iov_len==ptr)) {
+            iov.back().iov_len+=pageLen;
+        } else {
+            struct iovec v;
+            v.iov_base=ptr;
+            v.iov_len=pageLen;
+            iov.push_back(v);
+        }
+        addr+=pageLen;
+        len-=pageLen;
+    }
 }
 
 // Add a new function name-address mapping
@@ -438,6 +503,16 @@ VAddr AddressSpace::getFuncAddr(VAddr addr) const {
     return nameIt->addr;
 }
 
+// Given a code address, find the function it is in (best guess), false if none
+bool AddressSpace::findFunc(VAddr addr, std::string &func, VAddr &funcAddr) const {
+    NamesByAddr::const_iterator nameIt=namesByAddr.lower_bound(addr);
+    if(nameIt==namesByAddr.end())
+        return false;
+    func=nameIt->func;
+    funcAddr=nameIt->addr;
+    return true;
+}
+
 // Given a code address, return the function size (best guess)
 size_t AddressSpace::getFuncSize(VAddr addr) const {
     NamesByAddr::const_iterator nameIt=namesByAddr.lower_bound(addr);
@@ -613,9 +688,10 @@ void AddressSpace::moveSegment(VAddr oldaddr, VAddr newaddr) {
     size_t newPg=newSeg.pageNumLb();
     while(oldPg<oldSeg.pageNumUb()) {
         I(newPg<newSeg.pageNumUb());
-        PageDesc &oldPageDesc=pageTable[oldPg];
+        PageDesc *oldPageDesc=pageTable.find(oldPg);
+        I(oldPageDesc);
         PageDesc &newPageDesc=pageTable[newPg];
-        newPageDesc=oldPageDesc;
+        newPageDesc=*oldPageDesc;
         oldPg++;
         newPg++;
     }
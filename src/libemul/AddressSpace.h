@@ -2,6 +2,8 @@
 #define ADDRESS_SPACE_H
 
 #include <unistd.h>
+#include <sys/uio.h>
+#include <string.h>
 #include <vector>
 #include <set>
 #include <map>
@@ -28,7 +30,7 @@ typedef uint64_t MemAlignType;
 namespace MemSys {
 
 // Information about a page of physical memory
-class FrameDesc : public GCObject {
+class FrameDesc : public GCObject, public FileSys::HostMapUser {
 public:
     typedef SmartPtr<FrameDesc> pointer;
 private:
@@ -72,7 +74,14 @@ private:
     // Private constructor, used by the public create(fs,offs) method
     FrameDesc(FileSys::SeekableDescription *fdesc, off_t offs);
 
-    MemAlignType data[AddrSpacPageSize/sizeof(MemAlignType)];
+    // Contents of the frame. Pages of regular files point directly into a
+    // private host mapping of the page (hostMapped) until the file changes,
+    // other frames own their data.
+    MemAlignType *data;
+    bool          hostMapped;
+    static inline MemAlignType *newData(void) {
+        return new MemAlignType[AddrSpacPageSize/sizeof(MemAlignType)];
+    }
 #if (defined HAS_MEM_STATE)
     MemState state[AddrSpacPageSize/MemState::Granularity];
 #endif
@@ -88,15 +97,37 @@ public:
         size_t offs=(addr&AddrSpacPageOffsMask);
         *(reinterpret_cast<T *>(&(reinterpret_cast<int8_t *>(data)[offs])))=val;
     }
+    // Block copies, the block must be within this frame
+    inline void readBlock(VAddr addr, void *buf, size_t len) const {
+        size_t offs=(addr&AddrSpacPageOffsMask);
+        I(offs+len<=AddrSpacPageSize);
+        memcpy(buf,&(reinterpret_cast<const int8_t *>(data)[offs]),len);
+    }
+    inline void writeBlock(VAddr addr, const void *buf, size_t len) {
+        dirty=true;
+        size_t offs=(addr&AddrSpacPageOffsMask);
+        I(offs+len<=AddrSpacPageSize);
+        memcpy(&(reinterpret_cast<int8_t *>(data)[offs]),buf,len);
+    }
     inline bool isShared(void) const {
         return shared;
     }
+    // Frames are reference-counted by the pages that map them
+    inline bool isUniquelyMapped(void) const {
+        return (getRefCount()==1);
+    }
     FrameDesc();
     FrameDesc(FrameDesc &src);
     ~FrameDesc();
+    // The file is about to change, keep a copy of the page instead
+    void detachHost(void);
     int8_t *getData(VAddr addr) {
         return reinterpret_cast<int8_t *>(data)+(addr&AddrSpacPageOffsMask);
     }
+    // For writes done directly to getData() memory
+    void setDirty(void) {
+        dirty=true;
+    }
     PAddr getPAddr(VAddr addr) const {
         return basePAddr+(addr&AddrSpacPageOffsMask);
     }
@@ -158,11 +189,11 @@ private:
             return *this;
         }
         // Page number (not address) of the first page that overlaps with this segment
-        size_t pageNumLb(void) {
+        size_t pageNumLb(void) const {
             return (addr>>AddrSpacPageOffsBits);
         }
         // Page number (not address) of the first page after this segment with no overlap with it
-        size_t pageNumUb(void) {
+        size_t pageNumUb(void) const {
             I(len);
             return ((addr+len+AddrSpacPageSize-1)>>AddrSpacPageOffsBits);
         }
@@ -186,6 +217,9 @@ private:
             WrCopy  = 16
         } Flags;
         Flags flags;
+        // Decoded instructions in this page, one per RawInst slot (0 until the first mapInst)
+        static const size_t InstSlots=AddrSpacPageSize/sizeof(uint32_t);
+        InstDesc **insts;
         void copyFrame(void);
         void doWrCopy(void);
     public:
@@ -204,6 +238,32 @@ private:
                 doWrCopy();
             return frame->write<T>(addr,val);
         }
+        inline void readBlock(VAddr addr, void *buf, size_t len) const {
+            if(!(flags&CanRead))
+                fail("PageDesc::read from non-readable page\n");
+            frame->readBlock(addr,buf,len);
+        }
+        inline void writeBlock(VAddr addr, const void *buf, size_t len) {
+            if(!(flags&CanWrite))
+                fail("PageDesc::write from non-writeable page\n");
+            if(flags&WrCopy)
+                doWrCopy();
+            frame->writeBlock(addr,buf,len);
+        }
+        // Host memory of the frame at addr, checked like read and write
+        inline int8_t *getRdData(VAddr addr) const {
+            if(!(flags&CanRead))
+                fail("PageDesc::read from non-readable page\n");
+            return frame->getData(addr);
+        }
+        inline int8_t *getWrData(VAddr addr) {
+            if(!(flags&CanWrite))
+                fail("PageDesc::write from non-writeable page\n");
+            if(flags&WrCopy)
+                doWrCopy();
+            frame->setDirty();
+            return frame->getData(addr);
+        }
         template<class T>
         inline T fetch(VAddr addr) const {
             if(!(flags&CanExec))
@@ -214,9 +274,16 @@ private:
             I(!frame);
             I(!flags);
             frame=fdesc?(MemSys::FrameDesc::create(fdesc,offs)):(new MemSys::FrameDesc());
-            frameTable.insert(FrameTableEntry(frame,this));
             flags=static_cast<Flags>((r?CanRead:0)|(w?CanWrite:0)|(x?CanExec:0)|(s?Shared:(frame->isShared()?WrCopy:0)));
         }
+        void unmap(void);
+        inline InstDesc *getInst(VAddr addr) const {
+            if((!insts)||(addr&(sizeof(uint32_t)-1)))
+                return 0;
+            return insts[(addr&AddrSpacPageOffsMask)/sizeof(uint32_t)];
+        }
+        void mapInst(VAddr addr, InstDesc *inst);
+        void unmapInsts(size_t slotLb, size_t slotUb);
         void protect(bool r, bool w, bool x) {
             flags=static_cast<Flags>((r?CanRead:0)|(w?CanWrite:0)|(x?CanExec:0)|(flags&~(CanRead|CanWrite|CanExec)));
         }
@@ -240,45 +307,52 @@ private:
         void save(ChkWriter &out) const;
         ChkReader &operator=(ChkReader &in);
     };
+    // Pages of the 32-bit address space are in a two-level radix table, whose
+    // leaves are allocated on first use. Pages above 4GB (Mips64) are in pageMap.
     class PageTable {
+        static const PageNum LeafBits=10;
+        static const PageNum LeafSize=(1<<LeafBits);
+        static const PageNum RootSize=(1<<(32-AddrSpacPageOffsBits-LeafBits));
+        static const PageNum RadixPages=RootSize*LeafSize;
+        PageDesc *root[RootSize];
         typedef std::map<size_t,PageDesc> PageMap;
         PageMap pageMap;
-        class Cache {
-        public:
-            struct Entry {
-                PageNum   pageNum;
-                PageDesc *pageDesc;
-                Entry(void) : pageNum(0), pageDesc(0) {
-                }
-            };
-        private:
-            static const PageNum AddrSpaceCacheSize=(1<<16);
-            Entry cache[AddrSpaceCacheSize];
-        public:
-            Cache(void);
-            inline Entry &operator[](PageNum pageNum) {
-                return cache[pageNum%AddrSpaceCacheSize];
-            }
-            void unmap(PageNum pageNumLb, PageNum pageNumUb);
-        };
-        Cache cache;
+        PageDesc *newLeaf(PageNum rootIdx);
     public:
         PageTable(void);
         PageTable(PageTable &src);
+        ~PageTable(void);
+        // Allocates the leaf (or pageMap entry) of pageNum, for map and insert
         inline PageDesc &operator[](PageNum pageNum) {
-            Cache::Entry &centry=cache[pageNum];
-            if(centry.pageNum==pageNum)
-                return *(centry.pageDesc);
-            PageDesc &entry=pageMap[pageNum];
-            centry.pageNum=pageNum;
-            centry.pageDesc=&entry;
-            return entry;
+            if(pageNum<RadixPages) {
+                PageDesc *leaf=root[pageNum>>LeafBits];
+                if(!leaf)
+                    leaf=newLeaf(pageNum>>LeafBits);
+                return leaf[pageNum&(LeafSize-1)];
+            }
+            return pageMap[pageNum];
+        }
+        // Lookup that allocates nothing, 0 if pageNum has no PageDesc yet
+        inline PageDesc *find(PageNum pageNum) {
+            if(pageNum<RadixPages) {
+                PageDesc *leaf=root[pageNum>>LeafBits];
+                return leaf?(leaf+(pageNum&(LeafSize-1))):0;
+            }
+            PageMap::iterator it=pageMap.find(pageNum);
+            return (it!=pageMap.end())?(&it->second):0;
         }
         inline bool isMapped(PageNum pageNum) const {
-            return (pageMap.find(pageNum)!=pageMap.end());
+            if(pageNum<RadixPages) {
+                const PageDesc *leaf=root[pageNum>>LeafBits];
+                return leaf&&leaf[pageNum&(LeafSize-1)].getFrame();
+            }
+            PageMap::const_iterator it=pageMap.find(pageNum);
+            return (it!=pageMap.end())&&it->second.getFrame();
         }
         inline const PageDesc &operator[](PageNum pageNum) const {
             I(isMapped(pageNum));
+            if(pageNum<RadixPages)
+                return root[pageNum>>LeafBits][pageNum&(LeafSize-1)];
             PageMap::const_iterator it=pageMap.find(pageNum);
             return it->second;
         }
@@ -286,24 +360,16 @@ private:
                  bool r, bool w, bool x, bool s,
                  FileSys::SeekableDescription *fdesc, off_t offs);
         void unmap(PageNum pageNumLb, PageNum pageNumUb);
+        void unmapInsts(VAddr addrLb, VAddr addrUb);
     };
     PageTable pageTable;
-    // For each frame, the frame table says which pages map to it
-    struct FrameTableEntry {
-        MemSys::FrameDesc *frame;
-        PageDesc          *page;
-        FrameTableEntry(MemSys::FrameDesc *frame, PageDesc *page) : frame(frame), page(page) {
-        }
-        inline bool operator<(const FrameTableEntry &other) const {
-            if(frame<other.frame)
-                return true;
-            if(frame>other.frame)
-                return false;
-            return (page<other.page);
-        }
-    };
-    typedef std::set<FrameTableEntry> FrameTable;
-    static FrameTable frameTable;
+    // Page of an access, fails if addr was never mapped
+    inline PageDesc &getPage(VAddr addr) {
+        PageDesc *page=pageTable.find(getPageNum(addr));
+        if(!page)
+            fail("AddressSpace access to unmapped address 0x%lx\n",(unsigned long)addr);
+        return *page;
+    }
 
     static inline size_t getPageNum(VAddr addr) {
         return (addr>>AddrSpacPageOffsBits);
@@ -427,60 +493,17 @@ private:
     };
     typedef std::map<VAddr, TraceDesc, std::greater<VAddr> > TraceMap;
     TraceMap traceMap;
-    class InstTable {
-        typedef std::map<VAddr, InstDesc *> InstMap;
-        InstMap  instMap;
-        class Cache {
-        public:
-            struct Entry {
-                VAddr     instAddr;
-                InstDesc *instDesc;
-                Entry(void) : instAddr(0), instDesc(0) {
-                }
-            };
-        private:
-            static const size_t AddrSpaceCacheSize=(1<<16);
-            Entry cache[AddrSpaceCacheSize];
-        public:
-            Cache(void);
-            inline Entry &operator[](VAddr instAddr) {
-                return cache[instAddr%AddrSpaceCacheSize];
-            }
-            void unmap(VAddr instAddrLb, VAddr instAddrUb);
-        };
-        Cache cache;
-    public:
-        InstTable(void);
-        inline InstDesc *operator[](VAddr instAddr) {
-            Cache::Entry &centry=cache[instAddr];
-            if(centry.instAddr==instAddr)
-                return centry.instDesc;
-            InstMap::iterator it=instMap.find(instAddr);
-            if(it==instMap.end())
-                return 0;
-            centry.instAddr=instAddr;
-            centry.instDesc=it->second;
-            return it->second;
-        }
-        inline void map(VAddr instAddr, InstDesc *instDesc) {
-            I(instMap.find(instAddr)==instMap.end());
-            instMap[instAddr]=instDesc;
-        }
-        void unmap(VAddr instAddrLb, VAddr instAddrUb);
-    };
-    InstTable instTable;
-    // The InstMap is sorted by virtual address from lowest to highest
-    typedef std::map<VAddr, InstDesc *> InstMap;
-    InstMap  instMap;
 public:
     void createTrace(ThreadContext *context, VAddr addr);
     void mapTrace(InstDesc *binst, InstDesc *einst, VAddr baddr, VAddr eaddr);
     void delInsts(VAddr begAddr, VAddr endAddr);
+    // Decoded instructions are kept in per-page arrays in the page table
     inline void mapInst(VAddr addr,InstDesc *inst) {
-        instTable.map(addr,inst);
+        pageTable[getPageNum(addr)].mapInst(addr,inst);
     }
     inline InstDesc *virtToInst(VAddr addr) {
-        return instTable[addr];
+        PageDesc *page=pageTable.find(getPageNum(addr));
+        return page?page->getInst(addr):0;
     }
 public:
     AddressSpace(void);
@@ -489,29 +512,43 @@ public:
     // Saves this address space to a stream
     void save(ChkWriter &out) const;
     AddressSpace(ChkReader &in);
+    // Replaces segments and memory with the saved ones (keeps function names)
+    void restore(ChkReader &in);
     template<class T>
     inline T read(VAddr addr) {
-        I(pageTable[getPageNum(addr)].canRead());
         I(canRead(addr,sizeof(T)));
-        return pageTable[getPageNum(addr)].read<T>(addr);
+        return getPage(addr).read<T>(addr);
     }
     template<class T>
     inline void write(VAddr addr, T val) {
-        I(pageTable[getPageNum(addr)].canWrite());
         I(canWrite(addr,sizeof(T)));
-        return pageTable[getPageNum(addr)].write<T>(addr,val);
+        return getPage(addr).write<T>(addr,val);
+    }
+    // Copy a block that does not cross a page boundary with one page lookup
+    inline void readBlock(VAddr addr, void *buf, size_t len) {
+        I(getPageNum(addr)==getPageNum(addr+len-1));
+        getPage(addr).readBlock(addr,buf,len);
+    }
+    inline void writeBlock(VAddr addr, const void *buf, size_t len) {
+        I(getPageNum(addr)==getPageNum(addr+len-1));
+        getPage(addr).writeBlock(addr,buf,len);
     }
     template<class T>
     inline T fetch(VAddr addr) {
-        I(pageTable[getPageNum(addr)].canExec());
         I(canExec(addr,sizeof(T)));
-        return pageTable[getPageNum(addr)].fetch<T>(addr);
+        return getPage(addr).fetch<T>(addr);
     }
+    // Appends to iov the host memory of [addr,addr+len), one entry per page
+    // (or per run of pages that are contiguous in the host). If forWrite,
+    // copy-on-write is done first, so the memory can be written directly.
+    void getHostIov(VAddr addr, size_t len, bool forWrite, std::vector<struct iovec> &iov);
     bool canRead(VAddr addr) {
-        return pageTable[getPageNum(addr)].canRead();
+        PageDesc *page=pageTable.find(getPageNum(addr));
+        return page&&page->canRead();
     }
     bool canWrite(VAddr addr) {
-        return pageTable[getPageNum(addr)].canWrite();
+        PageDesc *page=pageTable.find(getPageNum(addr));
+        return page&&page->canWrite();
     }
 //  template<class T>
 //  inline T readMemRaw(VAddr addr){
@@ -636,6 +673,8 @@ public:
     size_t getFuncSize(VAddr addr) const;
     // Print name(s) of function(s) with given entry point
     void printFuncName(VAddr addr) const;
+    // Given a code address, find the function it is in (best guess), false if none
+    bool findFunc(VAddr addr, std::string &func, VAddr &funcAddr) const;
     //
     // Interception of function calls
     //
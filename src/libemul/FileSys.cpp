@@ -24,6 +24,8 @@ Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <limits.h>
 #include <poll.h>
 #include <iostream>
 // Needed to get I()
@@ -201,6 +203,30 @@ bool Description::isNonBlock(void) const {
 flags_t Description::getFlags(void) const {
     return flags;
 }
+ssize_t Description::readv(const struct iovec *iov, int iovcnt) {
+    ssize_t total=0;
+    for(int i=0; i<iovcnt; i++) {
+        ssize_t rcount=read(iov[i].iov_base,iov[i].iov_len);
+        if(rcount<0)
+            return total?total:rcount;
+        total+=rcount;
+        if((size_t)rcount<iov[i].iov_len)
+            break;
+    }
+    return total;
+}
+ssize_t Description::writev(const struct iovec *iov, int iovcnt) {
+    ssize_t total=0;
+    for(int i=0; i<iovcnt; i++) {
+        ssize_t wcount=write(iov[i].iov_base,iov[i].iov_len);
+        if(wcount<0)
+            return total?total:wcount;
+        total+=wcount;
+        if((size_t)wcount<iov[i].iov_len)
+            break;
+    }
+    return total;
+}
 NullNode::NullNode()
     : Node(0x000d,0,0,S_IFCHR|S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH,(ino_t)-1) {
 }
@@ -224,6 +250,36 @@ SeekableNode::SeekableNode(dev_t dev, uid_t uid, gid_t gid, mode_t mode, off_t l
     : Node(dev,uid,gid,mode,natInode) {
     Node::setSize(len);
 }
+ssize_t SeekableNode::preadv(const struct iovec *iov, int iovcnt, off_t offs) {
+    ssize_t total=0;
+    for(int i=0; i<iovcnt; i++) {
+        ssize_t rcount=pread(iov[i].iov_base,iov[i].iov_len,offs+total);
+        if(rcount<0)
+            return total?total:rcount;
+        total+=rcount;
+        if((size_t)rcount<iov[i].iov_len)
+            break;
+    }
+    return total;
+}
+ssize_t SeekableNode::pwritev(const struct iovec *iov, int iovcnt, off_t offs) {
+    ssize_t total=0;
+    for(int i=0; i<iovcnt; i++) {
+        ssize_t wcount=pwrite(iov[i].iov_base,iov[i].iov_len,offs+total);
+        if(wcount<0)
+            return total?total:wcount;
+        total+=wcount;
+        if((size_t)wcount<iov[i].iov_len)
+            break;
+    }
+    return total;
+}
+void *SeekableNode::mapHost(size_t size, off_t offs, HostMapUser *user) {
+    return 0;
+}
+void SeekableNode::unmapHost(void *addr, size_t size, HostMapUser *user) {
+    I(0);
+}
 SeekableDescription::SeekableDescription(Node *node, flags_t flags)
     : Description(node,flags), pos(0) {
 }
@@ -252,6 +308,22 @@ ssize_t SeekableDescription::write(const void *buf, size_t count) {
     }
     return wcount;
 }
+ssize_t SeekableDescription::readv(const struct iovec *iov, int iovcnt) {
+    ssize_t rcount=dynamic_cast<SeekableNode *>(node)->preadv(iov,iovcnt,pos);
+    if(rcount>0) {
+        pos+=rcount;
+        I(pos<=getSize());
+    }
+    return rcount;
+}
+ssize_t SeekableDescription::writev(const struct iovec *iov, int iovcnt) {
+    ssize_t wcount=dynamic_cast<SeekableNode *>(node)->pwritev(iov,iovcnt,pos);
+    if(wcount>0) {
+        pos+=wcount;
+        I(pos<=getSize());
+    }
+    return wcount;
+}
 ssize_t SeekableDescription::pread(void *buf, size_t count, off_t offs) {
     return dynamic_cast<SeekableNode *>(node)->pread(buf,count,offs);
 }
@@ -264,6 +336,12 @@ void SeekableDescription::mmap(void *data, size_t size, off_t offs) {
         fail("FileStatus::mmap failed with error %d\n",errno);
     memset((void *)((char *)data+rsize),0,size-rsize);
 }
+void *SeekableDescription::mapHost(size_t size, off_t offs, HostMapUser *user) {
+    return dynamic_cast<SeekableNode *>(node)->mapHost(size,offs,user);
+}
+void SeekableDescription::unmapHost(void *addr, size_t size, HostMapUser *user) {
+    dynamic_cast<SeekableNode *>(node)->unmapHost(addr,size,user);
+}
 void SeekableDescription::msync(void *data, size_t size, off_t offs) {
     off_t endoff=getSize();
     if(offs>=endoff)
@@ -282,11 +360,16 @@ FileNode::FileNode(struct stat &buf)
 FileNode::~FileNode(void) {
 //    if(close(fd)!=0)
 //      fail("FileSys::FileNode destructor could not close file %s\n",name.c_str());
+    // The frames that use the mappings hold a reference to the file
+    I(hostMaps.empty());
 }
 void FileNode::setSize(off_t nlen) {
+    HostMaps stale;
+    detachHostMaps(stale);
     if(truncate(getName()->c_str(),nlen)==-1)
         fail("FileNode::setSize truncate failed\n");
     Node::setSize(nlen);
+    unmapHostMaps(stale);
 }
 ssize_t FileNode::pread(void *buf, size_t count, off_t offs) {
     fd_t rfd=open(getName()->c_str(),O_RDONLY);
@@ -299,7 +382,119 @@ ssize_t FileNode::pread(void *buf, size_t count, off_t offs) {
     errno=rerror;
     return rcount;
 }
+///
+// The host preadv/pwritev take at most IOV_MAX buffers, longer vectors are
+// done in several calls on the same open file
+ssize_t FileNode::preadv(const struct iovec *iov, int iovcnt, off_t offs) {
+    fd_t rfd=open(getName()->c_str(),O_RDONLY);
+    if(rfd==-1)
+        fail("FileNode::preadv could not open %s\n",getName()->c_str());
+    ssize_t total=0;
+    ssize_t rcount=0;
+    I(iovcnt>=0);
+    size_t left=(iovcnt>0)?iovcnt:0;
+    while(left) {
+        size_t cnt=(left<(size_t)IOV_MAX)?left:(size_t)IOV_MAX;
+        size_t want=0;
+        for(size_t i=0; i<cnt; i++)
+            want+=iov[i].iov_len;
+        rcount=::preadv(rfd,iov,(int)cnt,offs+total);
+        if(rcount<0)
+            break;
+        total+=rcount;
+        if((size_t)rcount<want)
+            break;
+        iov+=cnt;
+        left-=cnt;
+    }
+    int     rerror=errno;
+    if(close(rfd)!=0)
+        fail("FileNode::preadv could not close %s\n",getName()->c_str());
+    errno=rerror;
+    return (rcount<0&&!total)?rcount:total;
+}
+ssize_t FileNode::pwritev(const struct iovec *iov, int iovcnt, off_t offs) {
+    HostMaps stale;
+    detachHostMaps(stale);
+    fd_t wfd=open(getName()->c_str(),O_WRONLY);
+    if(wfd==-1)
+        fail("FileNode::pwritev could not open %s\n",getName()->c_str());
+    off_t olen=getSize();
+    ssize_t total=0;
+    ssize_t wcount=0;
+    I(iovcnt>=0);
+    size_t left=(iovcnt>0)?iovcnt:0;
+    while(left) {
+        size_t cnt=(left<(size_t)IOV_MAX)?left:(size_t)IOV_MAX;
+        size_t want=0;
+        for(size_t i=0; i<cnt; i++)
+            want+=iov[i].iov_len;
+        wcount=::pwritev(wfd,iov,(int)cnt,offs+total);
+        if(wcount<0)
+            break;
+        total+=wcount;
+        if((size_t)wcount<want)
+            break;
+        iov+=cnt;
+        left-=cnt;
+    }
+    int     werror=errno;
+    if(close(wfd)!=0)
+        fail("FileNode::pwritev could not close %s\n",getName()->c_str());
+    unmapHostMaps(stale);
+    if((total>0)&&(offs+total>olen))
+        SeekableNode::setSize(offs+total);
+    errno=werror;
+    return (wcount<0&&!total)?wcount:total;
+}
+///
+// Each holder gets its own MAP_PRIVATE mapping, so guest pages never share
+// host memory. Untouched pages of a private mapping may follow later changes
+// of the file, so the holders copy their data out (detachHostMaps) before the
+// file is written or truncated. Ranges that are not host page aligned or that
+// are not within the file are not mapped, the caller reads them.
+void *FileNode::mapHost(size_t size, off_t offs, HostMapUser *user) {
+    static const size_t hostPageSize=sysconf(_SC_PAGESIZE);
+    if((offs<0)||(offs%hostPageSize)||(size%hostPageSize))
+        return 0;
+    // Host pages past the end of the file would fault
+    off_t mapLen=((getSize()+hostPageSize-1)/hostPageSize)*hostPageSize;
+    if(offs+(off_t)size>mapLen)
+        return 0;
+    fd_t rfd=open(getName()->c_str(),O_RDONLY);
+    if(rfd==-1)
+        fail("FileNode::mapHost could not open %s\n",getName()->c_str());
+    void *addr=::mmap(0,size,PROT_READ|PROT_WRITE,MAP_PRIVATE,rfd,offs);
+    if(close(rfd)!=0)
+        fail("FileNode::mapHost could not close %s\n",getName()->c_str());
+    if(addr==MAP_FAILED)
+        return 0;
+    I(!hostMaps.count(user));
+    hostMaps[user]=std::make_pair(addr,size);
+    return addr;
+}
+void FileNode::unmapHost(void *addr, size_t size, HostMapUser *user) {
+    HostMaps::iterator it=hostMaps.find(user);
+    I(it!=hostMaps.end());
+    I((it->second.first==addr)&&(it->second.second==size));
+    hostMaps.erase(it);
+    if(munmap(addr,size)!=0)
+        fail("FileNode::unmapHost munmap failed with error %d\n",errno);
+}
+void FileNode::detachHostMaps(HostMaps &stale) {
+    stale.swap(hostMaps);
+    for(HostMaps::iterator it=stale.begin(); it!=stale.end(); it++)
+        it->first->detachHost();
+}
+void FileNode::unmapHostMaps(HostMaps &stale) {
+    for(HostMaps::iterator it=stale.begin(); it!=stale.end(); it++)
+        if(munmap(it->second.first,it->second.second)!=0)
+            fail("FileNode::unmapHostMaps munmap failed with error %d\n",errno);
+    stale.clear();
+}
 ssize_t FileNode::pwrite(const void *buf, size_t count, off_t offs) {
+    HostMaps stale;
+    detachHostMaps(stale);
     fd_t wfd=open(getName()->c_str(),O_WRONLY);
     if(wfd==-1)
         fail("FileNode::pwrite could not open %s\n",getName()->c_str());
@@ -308,6 +503,7 @@ ssize_t FileNode::pwrite(const void *buf, size_t count, off_t offs) {
     int     werror=errno;
     if(close(wfd)!=0)
         fail("FileNode::pwrite could not close %s\n",getName()->c_str());
+    unmapHostMaps(stale);
     if((wcount>0)&&(offs+wcount>olen))
         SeekableNode::setSize(offs+wcount);
     errno=werror;
@@ -610,36 +806,59 @@ void OpenFiles::save(ChkWriter &out) const {
     for(FileDescriptors::const_iterator it=fileDescriptors.begin();
             it!=fileDescriptors.end(); it++) {
         out << "Desc " << it->first << " Cloex " << (it->second.cloexec?'+':'-');
-        /*
-        BaseStatus *st=it->second.description_old;
-        bool hasIndex=out.hasIndex(st);
-        out << " Status " << out.getIndex(st) << endl;
-        if(!hasIndex)
-          st->save(out);
-        */
+        // Regular files are reopened by name, anything else (standard streams,
+        // pipes, sockets) must already be open when the checkpoint is restored
+        FileDescription *fdesc=dynamic_cast<FileDescription *>((Description *)(it->second.description));
+        if(fdesc) {
+            const string name=fdesc->getName();
+            out << " File " << name.length() << " " << name;
+            out << " Flags " << (fdesc->getFlags()&~(O_CREAT|O_EXCL|O_TRUNC)) << " Pos " << fdesc->getPos();
+        } else {
+            out << " Inherit";
+        }
+        out << endl;
     }
 }
-OpenFiles::OpenFiles(ChkReader &in) {
+OpenFiles::OpenFiles(ChkReader &in)
+    : GCObject(), fileDescriptors() {
+    restore(in);
+}
+void OpenFiles::restore(ChkReader &in) {
+    FileDescriptors inherited;
+    inherited.swap(fileDescriptors);
     size_t _size;
     in >> "Descriptors: " >> _size >> endl;
     for(size_t i=0; i<_size; i++) {
         fd_t _fd;
         char _cloex;
         in >> "Desc " >> _fd >> " Cloex " >> _cloex;
-        /*
-        size_t _st;
-        in >> " Status " >> _st >> endl;
-        BaseStatus *st;
-        if(!in.hasObject(_st)){
-          in.newObject(_st);
-          st=BaseStatus::create(in);
-          in.setObject(_st,st);
-        }else{
-          st=reinterpret_cast<BaseStatus *>(in.getObject(_st));
+        char _kind;
+        in >> " " >> _kind;
+        if(_kind=='F') {
+            size_t _len;
+            in >> "ile " >> _len >> " ";
+            string name(_len,' ');
+            in.read(&name[0],_len);
+            flags_t _flags;
+            off_t _pos;
+            in >> " Flags " >> _flags >> " Pos " >> _pos;
+            Node *node=Node::lookup(name);
+            if(!node)
+                fail("OpenFiles::restore can not find file %s\n",name.c_str());
+            Description *description=Description::create(node,_flags);
+            if(!description)
+                fail("OpenFiles::restore can not open file %s\n",name.c_str());
+            dynamic_cast<SeekableDescription *>(description)->setPos(_pos);
+            openDescriptor(_fd,description);
+        } else {
+            in >> "nherit";
+            FileDescriptors::iterator it=inherited.find(_fd);
+            if(it==inherited.end())
+                fail("OpenFiles::restore descriptor %d is not open\n",(int)_fd);
+            openDescriptor(_fd,it->second.description);
         }
-        fileDescriptors[_fd].description_old=st;
-        fileDescriptors[_fd].cloexec=(_cloex=='+');
-        */
+        setCloexec(_fd,_cloex=='+');
+        in >> endl;
     }
 }
 
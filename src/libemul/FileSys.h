@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <dirent.h>
 #include <deque>
 #include <string>
@@ -123,6 +124,10 @@ public:
     virtual flags_t getFlags(void) const;
     virtual ssize_t read(void *buf, size_t count) = 0;
     virtual ssize_t write(const void *buf, size_t count) = 0;
+    // Scatter/gather read and write. By default one buffer at a time,
+    // stopping at the first short transfer.
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
 };
 class NullNode : public Node {
 protected:
@@ -138,12 +143,27 @@ public:
     virtual ssize_t read(void *buf, size_t count);
     virtual ssize_t write(const void *buf, size_t count);
 };
+// Holder of a host mapping from SeekableNode::mapHost. The node calls
+// detachHost before the file is written or truncated: the holder copies the
+// data out and stops using the mapping, which the node then unmaps.
+class HostMapUser {
+public:
+    virtual ~HostMapUser(void) {
+    }
+    virtual void detachHost(void) = 0;
+};
 class SeekableNode : public Node {
 protected:
     SeekableNode(dev_t dev, uid_t uid, gid_t gid, mode_t mode, off_t len, ino_t natInode);
 public:
     virtual ssize_t pread(void *buf, size_t count, off_t offs) = 0;
     virtual ssize_t pwrite(const void *buf, size_t count, off_t offs) = 0;
+    virtual ssize_t preadv(const struct iovec *iov, int iovcnt, off_t offs);
+    virtual ssize_t pwritev(const struct iovec *iov, int iovcnt, off_t offs);
+    // Host memory with a private (copy-on-write) mapping of [offs,offs+size)
+    // for user, or 0. Each call gets its own mapping.
+    virtual void *mapHost(size_t size, off_t offs, HostMapUser *user);
+    virtual void unmapHost(void *addr, size_t size, HostMapUser *user);
 };
 class SeekableDescription : public Description {
 public:
@@ -160,18 +180,34 @@ public:
     virtual ssize_t write(const void *buf, size_t count);
     virtual ssize_t pread(void *buf, size_t count, off_t offs);
     virtual ssize_t pwrite(const void *buf, size_t count, off_t offs);
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
     virtual void mmap(void *data, size_t size, off_t offs);
     virtual void msync(void *data, size_t size, off_t offs);
+    virtual void *mapHost(size_t size, off_t offs, HostMapUser *user);
+    virtual void unmapHost(void *addr, size_t size, HostMapUser *user);
 };
 class FileNode : public SeekableNode {
 private:
     fd_t fd;
+    // Host mappings of this file (mapHost) by holder
+    typedef std::map<HostMapUser *, std::pair<void *, size_t> > HostMaps;
+    HostMaps hostMaps;
+    // Called before the file changes, so the holders keep the old contents.
+    // The mappings are unmapped after the change (the data being written
+    // may be in one of them).
+    void detachHostMaps(HostMaps &stale);
+    static void unmapHostMaps(HostMaps &stale);
 public:
     FileNode(struct stat &buf);
     virtual ~FileNode(void);
     virtual void setSize(off_t nlen);
     virtual ssize_t pread(void *buf, size_t count, off_t offs);
     virtual ssize_t pwrite(const void *buf, size_t count, off_t offs);
+    virtual ssize_t preadv(const struct iovec *iov, int iovcnt, off_t offs);
+    virtual ssize_t pwritev(const struct iovec *iov, int iovcnt, off_t offs);
+    virtual void *mapHost(size_t size, off_t offs, HostMapUser *user);
+    virtual void unmapHost(void *addr, size_t size, HostMapUser *user);
 };
 class FileDescription : public SeekableDescription {
 public:
@@ -312,6 +348,8 @@ public:
     // Checkpointing save/restore
     void save(ChkWriter &out) const;
     OpenFiles(ChkReader &in);
+    // Replaces the open descriptors with the saved ones
+    void restore(ChkReader &in);
 };
 
 // Name space (mount and umount) information and file name translation
@@ -669,8 +669,10 @@ enum InstCtlInfoEnum {
     CtlMpDS = 0x0020,   // Can map the delay slot after this (decode only if mapping needed)
     CtlNoDS = 0x0040,   // This is a decoding for a branch instruction without a delay slot, skip to next if there is a dependent delay slot
     CtlMore = 0x0080,   // There are more instructions in this decoding
+    CtlNoCh = 0x0100,   // Can change the simulation state, not chained in rabbit mode (InstDesc::chain)
 
     CtlNMor = CtlNorm + CtlMore,
+    CtlNNCh = CtlNorm + CtlNoCh,
     CtlBr    = CtlBran + CtlMpDS,
     CtlBrL   = CtlBran + CtlMpDS + CtlLkly,
     CtlBrT   = CtlBran + CtlMpDS + CtlTarg,
@@ -1078,6 +1080,7 @@ public:
             }
             myinst->sescInst=createSescInst(myinst,origiaddr,curAddr-origiaddr,data.typ,data.ctl);
             myinst->aupdate=0;
+            myinst->chain=isChainable(data);
             if(!(data.ctl&CtlMore))
                 break;
             opIt++;
@@ -1097,6 +1100,7 @@ public:
                 ctinst->imm=0;
                 ctinst->iupdate=0;
                 ctinst->aupdate=0;
+                ctinst->chain=0;
 #if (defined DEBUG)
                 ctinst->addr=curAddr;
                 ctinst->typ=TypNop;
@@ -1106,6 +1110,21 @@ public:
             }
         }
     }
+    // ALU, FP and memory instructions only change registers and memory (and
+    // redirect to a signal handler or retry through iDesc). Nops, branches,
+    // traps and TM instructions call into the emulator or the next InstDesc.
+    static bool isChainable(const OpData &data) {
+        if(data.ctl&(CtlBran|CtlNoCh))
+            return false;
+        switch(data.typ&TypOpMask) {
+        case TypIntOp:
+        case TypFpOp:
+        case TypMemOp:
+            return true;
+        default:
+            return false;
+        }
+    }
     // Create a SESC Instruction for this static instruction
     static Instruction *createSescInst(const InstDesc *inst, VAddr iaddr, size_t deltaAddr, InstTypInfo typ, InstCtlInfo ctl) {
         Instruction *sescInst=new Instruction();
@@ -1527,7 +1546,7 @@ public:
                 MemT   mval=readMem<MemT>(context,addr);
 #if (defined TM)
                 if(htmManager) {
-                    tmRWStatus = htmManager->read(inst, context, addr, &context->getInstContext());
+                    tmRWStatus = htmManager->read(inst, context, addr, sizeof(MemT), &context->getInstContext());
                     context->updateRefetchAddrs(addr);
                     if(tmRWStatus == TMRW_SUCCESS) {
                         mval = readMemTM<MemT>(context, addr);
@@ -1555,7 +1574,7 @@ public:
                 MemT  val=readMem<MemT>(context,addr);
 #if (defined TM)
                 if(htmManager) {
-                    tmRWStatus = htmManager->read(inst, context, addr, &context->getInstContext());
+                    tmRWStatus = htmManager->read(inst, context, addr, sizeof(MemT), &context->getInstContext());
                     context->updateRefetchAddrs(addr);
                     if(tmRWStatus == TMRW_SUCCESS) {
                         val = readMemTM<MemT>(context, addr);
@@ -1608,7 +1627,7 @@ public:
                     size_t offs=(addr%tsiz);
                     EndianDefs<mode>::cvtEndian(val);
                     if(htmManager) {
-                        tmRWStatus = htmManager->write(inst, context, addr, &context->getInstContext());
+                        tmRWStatus = htmManager->write(inst, context, addr, sizeof(MemT), &context->getInstContext());
                         context->updateRefetchAddrs(addr);
                         if(tmRWStatus == TMRW_SUCCESS) {
                             writeMemTM<MemT>(context, addr, val);
@@ -1623,7 +1642,7 @@ public:
                     }
                 } else {
                     if(htmManager) {
-                        tmRWStatus = htmManager->write(inst, context, addr, &context->getInstContext());
+                        tmRWStatus = htmManager->write(inst, context, addr, sizeof(MemT), &context->getInstContext());
                         context->updateRefetchAddrs(addr);
                         if(tmRWStatus == TMRW_SUCCESS) {
                             writeMemTM<MemT>(context, addr, val);
@@ -1926,7 +1945,7 @@ DecodeInst<mode>::OpMap::OpMap(void) {
 //     ops[OpKey(0xFC000000,0xE8000000)]<<OpData("swc2", CtlNorm , MemOpSt4>());
 //     ops[OpKey(0xFC000000,0xF8000000)]<<OpData("sdc2", CtlNorm , MemOpSt8>());
     //ops[OpKey(0xFC000000,0xCC000000)]<<OpData("pref", CtlNorm , TypNop   , ArgNo  , ArgNo  , ArgNo  , ImmNo  , emulJJ<AddrRegImm>());
-    ops[OpKey(0xFC000000,0xCC000000)]<<OpData("pref", CtlNorm , MemOpLd4, ArgRt  , ArgRs  , ArgNo  , ImmSExt, emulJJ<AddrRegImm>());
+    ops[OpKey(0xFC000000,0xCC000000)]<<OpData("pref", CtlNNCh , MemOpLd4, ArgRt  , ArgRs  , ArgNo  , ImmSExt, emulJJ<AddrRegImm>());
     ops[OpKey(0xFC00003F,0x4C00000F)]<<OpData( "prefx",CtlNorm , TypNop   , ArgNo  , ArgNo  , ArgNo  , ImmNo  , emulNop);
 //     ops[OpKey(0xFC000000,0xCC000000)]<<OpData("pref", CtlNorm , TypNop>());
 //     ops[OpKey(0xFC00003F,0x4C00000F)]<<OpData( "prefx",CtlNorm , TypNop>());
@@ -2214,6 +2233,29 @@ void funcDataInitRet(ThreadContext* context, enum FuncName funcName) {
     context->createRet(funcName, rv);
 }
 
+static const retHandler_t savedRetHandlers[]= {
+    &nullRetHandler,
+    &handleLockRet,
+    &handleSpinLockRet,
+    &handleBarrierRet,
+    &handleTMBeginFallbackRet,
+    &handleTMEndFallbackRet,
+    &handleTMWaitRet,
+    &handleTMEndRet,
+};
+static const size_t numSavedRetHandlers=sizeof(savedRetHandlers)/sizeof(savedRetHandlers[0]);
+size_t retHandlerToId(retHandler_t retHandler) {
+    for(size_t id=0; id<numSavedRetHandlers; id++)
+        if(savedRetHandlers[id]==retHandler)
+            return id;
+    fail("retHandlerToId: return handler can not be saved\n");
+}
+retHandler_t idToRetHandler(size_t id) {
+    if(id>=numSavedRetHandlers)
+        fail("idToRetHandler: invalid return handler %lu\n",(unsigned long)id);
+    return savedRetHandlers[id];
+}
+
 // pthread_mutex call/return
 void handleLockCall(InstDesc *inst, ThreadContext *context) {
     uint32_t ra = ArchDefs<ExecModeMips32>::getReg<uint32_t,RegTypeGpr>(context,ArchDefs<ExecModeMips32>::RegRA);
@@ -2287,6 +2329,9 @@ void handleTMBeginCall(InstDesc *inst, ThreadContext *context) {
     if(ThreadContext::inMain) {
         uint32_t arg = ArchDefs<ExecModeMips32>::getReg<uint32_t,RegTypeGpr>(context,ArchDefs<ExecModeMips32>::RegA0);
         context->setTMlibUserTid(arg);
+        // The return address is after the jal and its delay slot
+        uint32_t ra = ArchDefs<ExecModeMips32>::getReg<uint32_t,RegTypeGpr>(context,ArchDefs<ExecModeMips32>::RegRA);
+        context->setTMBeginSite(ra - 8);
 
         funcDataInitCall(context, FUNC_TM_BEGIN);
     }
@@ -2314,6 +2359,8 @@ void handleTMEndFallbackRet(InstDesc *inst, ThreadContext *context) {
     if(ThreadContext::inMain) {
         funcDataInitRet(context, FUNC_TM_END_FALLBACK);
         context->completeFallback();
+        // The atomic block is over, later raw tm.begins are not part of it
+        context->setTMBeginSite(0);
     }
 }
 
@@ -2338,6 +2385,8 @@ void handleTMEndCall(InstDesc *inst, ThreadContext *context) {
 void handleTMEndRet(InstDesc *inst, ThreadContext *context) {
     if(ThreadContext::inMain) {
         funcDataInitRet(context, FUNC_TM_END);
+        // The atomic block is over, later raw tm.begins are not part of it
+        context->setTMBeginSite(0);
     }
 }
 
@@ -50,6 +50,9 @@ void addRetHandler(ThreadContext* context, retHandler_t retHandler);
 void nullRetHandler(InstDesc *inst, ThreadContext *context);
 void funcDataInitCall(ThreadContext* context, enum FuncName funcName, retHandler_t retHandler = &nullRetHandler);
 void funcDataInitRet(ThreadContext* context, enum FuncName funcName);
+// Checkpointing: pending return handlers are saved as an index into a fixed table
+size_t retHandlerToId(retHandler_t retHandler);
+retHandler_t idToRetHandler(size_t id);
 
 // pthread_mutex call/return
 void handleLockCall(InstDesc *inst, ThreadContext *context);
@@ -207,6 +210,9 @@ public:
     RegName      regSrc2;
     uint8_t      iupdate;
     uint8_t      aupdate;
+    // Can not suspend, exit, signal or end fast-forward: rabbit mode goes on to
+    // the next InstDesc of the trace without checking the thread state
+    uint8_t      chain;
 #if (defined DEBUG)
     InstTypInfo  typ;
     VAddr        addr;
@@ -214,7 +220,7 @@ public:
     const char  *name;
 #endif
 public:
-    InstDesc(void) : sescInst(0) {
+    InstDesc(void) : sescInst(0), chain(0) {
 #if (defined DEBUG)
 //    emul=0;
 //    regDst=RegNone;
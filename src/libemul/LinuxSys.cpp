@@ -124,6 +124,7 @@ class RealLinuxSys : public LinuxSys, public ArchDefs<mode> {
     const static decltype(Base::VENOSYS      ) VENOSYS       = Base::VENOSYS;
     const static decltype(Base::VELOOP       ) VELOOP        = Base::VELOOP;
     const static decltype(Base::VEAFNOSUPPORT) VEAFNOSUPPORT = Base::VEAFNOSUPPORT;
+    const static decltype(Base::VETIMEDOUT   ) VETIMEDOUT    = Base::VETIMEDOUT;
     static Tint errorFromNative(int err=errno) {
         switch(err) {
         case EPERM:
@@ -198,6 +199,8 @@ class RealLinuxSys : public LinuxSys, public ArchDefs<mode> {
             return VENOSYS;
         case EAFNOSUPPORT:
             return VEAFNOSUPPORT;
+        case ETIMEDOUT:
+            return VETIMEDOUT;
         default:
             fail("errorFromNative(%d) with unsupported native error code\n");
         }
@@ -341,7 +344,8 @@ class RealLinuxSys : public LinuxSys, public ArchDefs<mode> {
     const static decltype(Base::VFUTEX_OP_CMP_GE) VFUTEX_OP_CMP_GE = Base::VFUTEX_OP_CMP_GE;
     const static decltype(Base::V__NR_futex) V__NR_futex = Base::V__NR_futex;
     bool futexCheck(ThreadContext *context, Tpointer_t futex, Tint val);
-    void futexWait(ThreadContext *context, Tpointer_t futex);
+    void futexWait(ThreadContext *context, Tpointer_t futex, Time_t deadline);
+    static void futexTimeout(int32_t tid, uint32_t waitId);
     int futexWake(ThreadContext *context, Tpointer_t futex, int nr_wake);
     int futexMove(ThreadContext *context, Tpointer_t srcFutex, Tpointer_t dstFutex, int nr_move);
     void sysFutex(ThreadContext *context, InstDesc *inst, int argPos);
@@ -1680,8 +1684,76 @@ T RealLinuxSys<mode>::popStruct(ThreadContext *context) {
     setStackPointer(context,newsp);
     return T(context,(stackGrowthSign()>0)?newsp:oldsp);
 }
-typedef std::multimap<VAddr,ThreadContext *> ContextMultiMap;
-ContextMultiMap futexContexts;
+///
+// Threads waiting on futexes. Each futex address has its own FIFO queue of
+// waiters, linked through the FutexWaiter of each tid, so that waking,
+// requeueing or timing out a waiter does not depend on how many threads are
+// waiting on other futexes.
+struct FutexWaiter {
+    ThreadContext *context;
+    VAddr          futex;
+    FutexWaiter   *prev;
+    FutexWaiter   *next;
+    // Incremented on every wait, tells a stale timeout apart from the current one
+    uint32_t       waitId;
+    // Cycle when the wait times out, zero if it has no timeout
+    Time_t         deadline;
+    FutexWaiter(): context(0), futex(0), prev(0), next(0), waitId(0), deadline(0) {
+    }
+};
+struct FutexQueue {
+    FutexWaiter *head;
+    FutexWaiter *tail;
+    FutexQueue(): head(0), tail(0) {
+    }
+    void push(FutexWaiter *waiter) {
+        waiter->prev=tail;
+        waiter->next=0;
+        if(tail)
+            tail->next=waiter;
+        else
+            head=waiter;
+        tail=waiter;
+    }
+    void remove(FutexWaiter *waiter) {
+        if(waiter->prev)
+            waiter->prev->next=waiter->next;
+        else
+            head=waiter->next;
+        if(waiter->next)
+            waiter->next->prev=waiter->prev;
+        else
+            tail=waiter->prev;
+        waiter->prev=waiter->next=0;
+    }
+};
+typedef HASH_MAP<VAddr,FutexQueue> FutexQueues;
+FutexQueues futexQueues;
+// Indexed by tid, allocated on the first wait of each thread
+std::vector<FutexWaiter *> futexWaiters;
+size_t nFutexWaiters=0;
+
+static FutexWaiter *getFutexWaiter(int32_t tid) {
+    if((size_t)tid>=futexWaiters.size())
+        futexWaiters.resize(tid+1,0);
+    if(!futexWaiters[tid])
+        futexWaiters[tid]=new FutexWaiter();
+    return futexWaiters[tid];
+}
+static void futexEnqueue(FutexWaiter *waiter, VAddr futex) {
+    waiter->futex=futex;
+    futexQueues[futex].push(waiter);
+    nFutexWaiters++;
+}
+// Removes a waiter from its queue, erasing the queue once it is empty
+static void futexDequeue(FutexQueues::iterator queueIt, FutexWaiter *waiter) {
+    I(queueIt->first==waiter->futex);
+    queueIt->second.remove(waiter);
+    if(!queueIt->second.head)
+        futexQueues.erase(queueIt);
+    waiter->context=0;
+    nFutexWaiters--;
+}
 
 template<ExecMode mode>
 bool RealLinuxSys<mode>::futexCheck(ThreadContext *context, Tpointer_t futex, Tint val) {
@@ -1691,19 +1763,43 @@ bool RealLinuxSys<mode>::futexCheck(ThreadContext *context, Tpointer_t futex, Ti
     return rv;
 }
 template<ExecMode mode>
-void RealLinuxSys<mode>::futexWait(ThreadContext *context, Tpointer_t futex) {
-    futexContexts.insert(ContextMultiMap::value_type(futex,context));
+void RealLinuxSys<mode>::futexWait(ThreadContext *context, Tpointer_t futex, Time_t deadline) {
+    FutexWaiter *waiter=getFutexWaiter(context->gettid());
+    I(!waiter->context);
+    waiter->context=context;
+    waiter->waitId++;
+    waiter->deadline=deadline;
+    futexEnqueue(waiter,futex);
+    if(deadline)
+        CallbackFunction2<int32_t,uint32_t,&RealLinuxSys<mode>::futexTimeout>::scheduleAbs(deadline,context->gettid(),waiter->waitId);
 #if (defined DEBUG_SIGNALS)
     suspSet.insert(context->gettid());
 #endif
     context->suspend();
 }
 template<ExecMode mode>
+void RealLinuxSys<mode>::futexTimeout(int32_t tid, uint32_t waitId) {
+    if((size_t)tid>=futexWaiters.size()||!futexWaiters[tid])
+        return;
+    FutexWaiter *waiter=futexWaiters[tid];
+    // The thread was woken up (and maybe waits again) before the timeout
+    if(!waiter->context||waiter->waitId!=waitId)
+        return;
+    ThreadContext *wcontext=waiter->context;
+    futexDequeue(futexQueues.find(waiter->futex),waiter);
+    wcontext->resume();
+    setSysErr(wcontext,VETIMEDOUT);
+}
+template<ExecMode mode>
 int RealLinuxSys<mode>::futexWake(ThreadContext *context, Tpointer_t futex, int nr_wake) {
     int rv_wake=0;
-    while((rv_wake<nr_wake)&&(futexContexts.lower_bound(futex)!=futexContexts.upper_bound(futex))) {
-        ThreadContext *wcontext=futexContexts.lower_bound(futex)->second;
-        futexContexts.erase(futexContexts.lower_bound(futex));
+    while(rv_wake<nr_wake) {
+        FutexQueues::iterator queueIt=futexQueues.find(futex);
+        if(queueIt==futexQueues.end())
+            break;
+        FutexWaiter *waiter=queueIt->second.head;
+        ThreadContext *wcontext=waiter->context;
+        futexDequeue(queueIt,waiter);
         wcontext->resume();
         setSysRet(wcontext);
         rv_wake++;
@@ -1714,15 +1810,70 @@ template<ExecMode mode>
 int RealLinuxSys<mode>::futexMove(ThreadContext *context, Tpointer_t srcFutex,
                                   Tpointer_t dstFutex, int nr_move) {
     int rv_move=0;
-    while((rv_move<nr_move)&&(futexContexts.lower_bound(srcFutex)!=futexContexts.upper_bound(srcFutex))) {
-        ThreadContext *wcontext=futexContexts.lower_bound(srcFutex)->second;
-        futexContexts.erase(futexContexts.lower_bound(srcFutex));
-        futexContexts.insert(ContextMultiMap::value_type(dstFutex,wcontext));
+    if(srcFutex==dstFutex) {
+        // Requeueing to the same futex leaves the order as it is
+        FutexQueues::const_iterator queueIt=futexQueues.find(srcFutex);
+        if(queueIt!=futexQueues.end())
+            for(FutexWaiter *waiter=queueIt->second.head; waiter&&(rv_move<nr_move); waiter=waiter->next)
+                rv_move++;
+        return rv_move;
+    }
+    FutexQueues::iterator srcIt=futexQueues.find(srcFutex);
+    if((srcIt==futexQueues.end())||(nr_move<=0))
+        return 0;
+    // Inserting the destination queue can rehash and invalidate srcIt
+    FutexQueue &dstQueue=futexQueues[dstFutex];
+    srcIt=futexQueues.find(srcFutex);
+    FutexQueue &srcQueue=srcIt->second;
+    while((rv_move<nr_move)&&srcQueue.head) {
+        FutexWaiter *waiter=srcQueue.head;
+        srcQueue.remove(waiter);
+        waiter->futex=dstFutex;
+        dstQueue.push(waiter);
         rv_move++;
     }
+    if(!srcQueue.head)
+        futexQueues.erase(srcIt);
     return rv_move;
 }
 
+void LinuxSys::saveFutexes(ChkWriter &out) {
+    // A thread suspended for any other reason can not be restored
+    for(int32_t pid=0; pid<ThreadContext::getPidUb(); pid++) {
+        ThreadContext *context=ThreadContext::getContext(pid);
+        if(!context||!context->isSuspended())
+            continue;
+        if((size_t)pid>=futexWaiters.size()||!futexWaiters[pid]||(futexWaiters[pid]->context!=context))
+            fail("LinuxSys::saveFutexes thread %d is suspended outside of a futex\n",pid);
+        if(futexWaiters[pid]->deadline)
+            fail("LinuxSys::saveFutexes thread %d is in a futex wait with a timeout\n",pid);
+    }
+    out << "Futexes " << nFutexWaiters << endl;
+    // Waiters on the same futex are listed in wake-up order
+    for(FutexQueues::const_iterator queueIt=futexQueues.begin(); queueIt!=futexQueues.end(); queueIt++)
+        for(FutexWaiter *waiter=queueIt->second.head; waiter; waiter=waiter->next)
+            out << "Futex " << queueIt->first << " Tid " << waiter->context->gettid() << endl;
+}
+void LinuxSys::restoreFutexes(ChkReader &in) {
+    I(futexQueues.empty());
+    size_t _count;
+    in >> "Futexes " >> _count >> endl;
+    for(size_t i=0; i<_count; i++) {
+        VAddr _futex;
+        int _tid;
+        in >> "Futex " >> _futex >> " Tid " >> _tid >> endl;
+        ThreadContext *context=ThreadContext::getContext(_tid);
+        if(!context)
+            fail("LinuxSys::restoreFutexes no thread with tid %d\n",_tid);
+        FutexWaiter *waiter=getFutexWaiter(_tid);
+        waiter->context=context;
+        waiter->waitId++;
+        waiter->deadline=0;
+        futexEnqueue(waiter,_futex);
+        context->suspend();
+    }
+}
+
 bool LinuxSys::handleSignals(ThreadContext *context) const {
     while(context->hasReadySignal()) {
         SigInfo *sigInfo=context->nextReadySignal();
@@ -2395,10 +2546,24 @@ void RealLinuxSys<mode>::sysFutex(ThreadContext *context, InstDesc *inst, int ar
         Tint       val;
         Tpointer_t timeout;
         args >> val >> timeout;
-        if(timeout)
-            fail("LinuxSys::sysFutex non-zero timeout unsupported for FUTEX_WAIT");
-        if(futexCheck(context,futex,val))
-            futexWait(context,futex);
+        // The timeout is relative for FUTEX_WAIT and absolute for FUTEX_WAIT_BITSET,
+        // in both cases simulated time is globalClock/clockFreq (as in gettimeofday)
+        Time_t deadline=0;
+        if(timeout) {
+            if(!context->canRead(timeout,Ttimespec::getSize()))
+                return setSysErr(context,VEFAULT);
+            Ttimespec ts(context,timeout);
+            if((ts.tv_sec<0)||(ts.tv_nsec<0)||(ts.tv_nsec>=1000000000))
+                return setSysErr(context,VEINVAL);
+            deadline=(Time_t)ts.tv_sec*osSim->clockFreq+((Time_t)ts.tv_nsec*osSim->clockFreq)/1000000000;
+            if((op&VFUTEX_CMD_MASK)==VFUTEX_WAIT)
+                deadline+=globalClock;
+        }
+        if(!futexCheck(context,futex,val))
+            break;
+        if(timeout&&(deadline<=globalClock))
+            return setSysErr(context,VETIMEDOUT);
+        futexWait(context,futex,deadline);
     }
     break;
     case VFUTEX_WAKE_BITSET:
@@ -2406,8 +2571,6 @@ void RealLinuxSys<mode>::sysFutex(ThreadContext *context, InstDesc *inst, int ar
         Tint       nr_wake;
         Tpointer_t timeout;
         args >> nr_wake >> timeout;
-        if(timeout)
-            fail("LinuxSys::sysFutex non-zero timeout unsupported for FUTEX_WAKE");
         setSysRet(context,futexWake(context,futex,nr_wake));
     }
     break;
@@ -3633,18 +3796,16 @@ void RealLinuxSys<mode>::sysRead(ThreadContext *context, InstDesc *inst, int arg
         context->suspend();
         return;
     }
-    uint8_t * rbuf = new uint8_t[count];
-    ssize_t rcount=description->read(rbuf,count);
+    // Read directly into the guest frames
+    std::vector<struct iovec> iov;
+    context->getAddressSpace()->getHostIov(buf,count,true,iov);
+    ssize_t rcount=description->readv(iov.data(),iov.size());
     I(rcount>=0);
 #ifdef DEBUG_FILES
     printf("[%d] read %d wants %ld gets %ld bytes\n",context->gettid(),fd,(long)count,(long)rcount);
 #endif
-    if(rcount==-1) {
-        delete [] rbuf;
+    if(rcount==-1)
         return setSysErr(context);
-    }
-    context->writeMemFromBuf(buf,(size_t)rcount,rbuf);
-    delete [] rbuf;
     return setSysRet(context,Tssize_t(rcount));
 }
 template<ExecMode mode>
@@ -3692,10 +3853,10 @@ void RealLinuxSys<mode>::sysWrite(ThreadContext *context, InstDesc *inst, int ar
         context->suspend();
         return;
     }
-    uint8_t *rbuf = new uint8_t[count];
-    context->readMemToBuf(buf,(size_t)count,rbuf);
-    ssize_t wcount=description->write(rbuf,count);
-    delete [] rbuf;
+    // Write directly from the guest frames
+    std::vector<struct iovec> iov;
+    context->getAddressSpace()->getHostIov(buf,count,false,iov);
+    ssize_t wcount=description->writev(iov.data(),iov.size());
     I(wcount>=0);
 #ifdef DEBUG_FILES
     printf("[%d] write %d wants %ld gets %ld bytes\n",context->gettid(),fd,(long)count,(long)wcount);
@@ -3729,19 +3890,18 @@ void RealLinuxSys<mode>::sysWriteV(ThreadContext *context, InstDesc *inst, int a
     FileSys::Description *description=openFiles->getDescription(fd);
     if(!description->canWr())
         return setSysErr(context,VEBADF);
-    uint8_t wbuf[count];
-    size_t  pos=0;
+    // Gather directly from the guest frames
+    std::vector<struct iovec> hostIov;
     for(Tint i=0; i<iovcnt; i++) {
         Tiovec iov(context,vector+i*Tiovec::getSize());
         I(context->canRead(iov.iov_base,iov.iov_len));
-        context->readMemToBuf(iov.iov_base,iov.iov_len,wbuf+pos);
-        pos+=iov.iov_len;
+        context->getAddressSpace()->getHostIov(iov.iov_base,iov.iov_len,false,hostIov);
     }
     FileSys::StreamDescription *sdescription=dynamic_cast<FileSys::StreamDescription *>(description);
     if(sdescription&&sdescription->willWrBlock()) {
         fail("writev would block!\n");
     }
-    ssize_t wcount=description->write(wbuf,count);
+    ssize_t wcount=description->writev(hostIov.data(),hostIov.size());
 #ifdef DEBUG_FILES
     int e=errno;
     printf("[%d] writev %d wants %ld gets %ld bytes\n",context->gettid(),fd,(long)count,(long)wcount);
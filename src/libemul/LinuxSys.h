@@ -26,6 +26,9 @@ public:
     virtual void setProgArgs(ThreadContext *context, int argc, char **argv, int envc, char **envp) const = 0;
     virtual void exitRobustList(ThreadContext *context, VAddr robust_list) = 0;
     virtual void clearChildTid(ThreadContext *context, VAddr &clear_child_tid) = 0;
+    // Checkpointing save/restore of the threads waiting on futexes
+    static void saveFutexes(ChkWriter &out);
+    static void restoreFutexes(ChkReader &in);
 };
 
 #endif // !(defined LINUXSYS_H)
@@ -0,0 +1,45 @@
+#include "BBVProfile.h"
+#include "libemul/EmulInit.h"
+
+BBVProfile *BBVProfile::active = 0;
+
+BBVProfile::BBVProfile(const char *fname, int64_t intervalSize):
+    intervalSize(intervalSize),
+    nInsts(0),
+    nIntervals(0),
+    nBlockIds(0) {
+    out = fopen(fname, "w");
+    if(!out) {
+        fail("BBVProfile: can not create %s\n", fname);
+    }
+}
+
+BBVProfile::~BBVProfile() {
+    for(size_t pid = 0; pid < threads.size(); pid++) {
+        if(!threads[pid].touched.empty()) {
+            endInterval();
+            break;
+        }
+    }
+    fclose(out);
+}
+
+///
+// Write one line of the .bb file (T:id:count :id:count ...) and start a new
+// interval. The threads are listed in pid order, and the blocks of a thread in
+// the order they were first executed in the interval.
+void BBVProfile::endInterval() {
+    fputc('T', out);
+    for(size_t pid = 0; pid < threads.size(); pid++) {
+        std::vector<BlockCount *> &touched = threads[pid].touched;
+        for(size_t i = 0; i < touched.size(); i++) {
+            fprintf(out, ":%u:%llu ", touched[i]->id, (unsigned long long)touched[i]->nInsts);
+            touched[i]->nInsts = 0;
+        }
+        touched.clear();
+    }
+    fputc('\n', out);
+    // Carry the overshoot so interval k starts within a block of k*intervalSize
+    nInsts = (nInsts > intervalSize) ? (nInsts - intervalSize) : 0;
+    nIntervals++;
+}
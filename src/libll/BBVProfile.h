@@ -0,0 +1,85 @@
+#ifndef BBV_PROFILE_H
+#define BBV_PROFILE_H
+
+#include <stdio.h>
+#include <vector>
+#include "estl.h"
+#include "Snippets.h"
+#include "libemul/Addressing.h"
+
+///
+// Basic-block vectors of the instructions run in rabbit mode
+// (ThreadContext::skipInsts), written in SimPoint's .bb format. A block starts
+// where the instruction stream stops being sequential, so it is identified by
+// the address of its first instruction. Each thread has its own vector: the
+// dimensions of an interval are (thread, block) pairs, and an interval ends
+// after intervalSize instructions of all the threads together.
+class BBVProfile {
+public:
+    // Block being executed by a thread
+    struct Block {
+        VAddr    addr;
+        uint32_t len;
+        Block(): addr(0), len(0) {
+        }
+    };
+
+    // Profile that skipInsts updates, 0 if there is none
+    static BBVProfile *active;
+
+    BBVProfile(const char *fname, int64_t intervalSize);
+    // Writes the last (partial) interval
+    ~BBVProfile();
+
+    Block &getBlock(Pid_t pid) {
+        if((size_t)pid>=threads.size())
+            threads.resize(pid+1);
+        return threads[pid].block;
+    }
+    // The current block of pid ended, add it to the interval
+    void endBlock(Pid_t pid) {
+        ThreadBBV &thread=threads[pid];
+        BlockCount &count=thread.counts[thread.block.addr];
+        if(!count.nInsts) {
+            if(!count.id)
+                count.id=++nBlockIds;
+            thread.touched.push_back(&count);
+        }
+        count.nInsts+=thread.block.len;
+        nInsts+=thread.block.len;
+        thread.block.len=0;
+        if(nInsts>=intervalSize)
+            endInterval();
+    }
+
+    int64_t getNumIntervals() const {
+        return nIntervals;
+    }
+
+private:
+    struct BlockCount {
+        // SimPoint dimension (from 1), 0 until the block is first seen
+        uint32_t id;
+        // Instructions executed in the block in this interval
+        uint64_t nInsts;
+        BlockCount(): id(0), nInsts(0) {
+        }
+    };
+    struct ThreadBBV {
+        Block block;
+        HASH_MAP<VAddr, BlockCount> counts;
+        // Blocks with a non-zero count in this interval
+        std::vector<BlockCount *> touched;
+    };
+
+    void endInterval();
+
+    FILE    *out;
+    int64_t  intervalSize;
+    int64_t  nInsts;
+    int64_t  nIntervals;
+    uint32_t nBlockIds;
+    std::vector<ThreadBBV> threads;
+};
+
+#endif
@@ -77,6 +77,15 @@ public:
     }
     DInst *executePC();
 
+    // True if the context can not execute (executePC returns 0) this cycle
+    bool isStalled() const {
+        return context && context->checkStall();
+    }
+    Time_t getStallUntil() const {
+        I(isStalled());
+        return context->getStallUntil();
+    }
+
     void goRabbitMode(long long n2skip=0);
     void dump(const char *str) const;
 };
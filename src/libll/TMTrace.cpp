@@ -0,0 +1,131 @@
+#include <string.h>
+#include <chrono>
+#include "TMTrace.h"
+#include "libemul/EmulInit.h"
+
+TMTrace *TMTrace::active = 0;
+
+static const char TraceMagic[8] = { 'S', 'E', 'S', 'C', 'T', 'M', 'T', 1 };
+
+TMTrace::TMTrace(const char *fname, size_t ringSize):
+    ringSize(ringSize),
+    done(false),
+    nRecords(0),
+    nStalls(0) {
+    if(ringSize == 0) {
+        fail("TMTrace: ring size can not be 0\n");
+    }
+    out = fopen(fname, "wb");
+    if(!out) {
+        fail("TMTrace: can not create %s\n", fname);
+    }
+    uint32_t recordSize = sizeof(TMTraceRecord);
+    fwrite(TraceMagic, sizeof(TraceMagic), 1, out);
+    fwrite(&recordSize, sizeof(recordSize), 1, out);
+
+    writer = std::thread(&TMTrace::writerLoop, this);
+}
+
+TMTrace::~TMTrace() {
+    done.store(true, std::memory_order_release);
+    wakeup.notify_one();
+    writer.join();
+    fclose(out);
+
+    for(size_t pid = 0; pid < rings.size(); pid++) {
+        delete rings[pid];
+    }
+}
+
+TMTrace::Ring *TMTrace::getRing(Pid_t pid) {
+    if((size_t)pid < rings.size() && rings[pid]) {
+        return rings[pid];
+    }
+    std::lock_guard<std::mutex> lock(ringsLock);
+    if((size_t)pid >= rings.size()) {
+        rings.resize(pid + 1, 0);
+    }
+    rings[pid] = new Ring(ringSize);
+    return rings[pid];
+}
+
+void TMTrace::record(Pid_t pid, TMTraceEvent type, VAddr pc, uint64_t utid, uint32_t arg,
+        uint32_t abortType, Pid_t aborter) {
+    Ring *ring = getRing(pid);
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    while(head - tail == ringSize) {
+        nStalls++;
+        wakeup.notify_one();
+        std::this_thread::yield();
+        tail = ring->tail.load(std::memory_order_acquire);
+    }
+
+    TMTraceRecord& rec = ring->recs[head % ringSize];
+    rec.cycle       = globalClock;
+    rec.utid        = utid;
+    rec.pc          = (uint32_t)pc;
+    rec.arg         = arg;
+    rec.pid         = (int16_t)pid;
+    rec.aborter     = (int16_t)aborter;
+    rec.type        = (uint8_t)type;
+    rec.abortType   = abortType > 0xFF ? 0xFF : (uint8_t)abortType;
+    rec.reserved    = 0;
+    ring->head.store(head + 1, std::memory_order_release);
+    nRecords++;
+
+    // Wake the writer up before the ring fills up
+    if(head + 1 - tail == ringSize / 2) {
+        wakeup.notify_one();
+    }
+}
+
+///
+// Write the records of all the rings, returns the number written
+size_t TMTrace::drainRings() {
+    std::vector<Ring *> toDrain;
+    {
+        std::lock_guard<std::mutex> lock(ringsLock);
+        toDrain = rings;
+    }
+
+    size_t nWritten = 0;
+    for(size_t pid = 0; pid < toDrain.size(); pid++) {
+        Ring *ring = toDrain[pid];
+        if(ring == 0) {
+            continue;
+        }
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        while(tail != head) {
+            // Up to the end of the ring in one write
+            size_t first = tail % ringSize;
+            size_t n = head - tail;
+            if(first + n > ringSize) {
+                n = ringSize - first;
+            }
+            fwrite(&ring->recs[first], sizeof(TMTraceRecord), n, out);
+            tail += n;
+            nWritten += n;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+    return nWritten;
+}
+
+void TMTrace::writerLoop() {
+    while(true) {
+        // Everything recorded before done was set is drained below
+        bool finish = done.load(std::memory_order_acquire);
+        size_t nWritten = drainRings();
+        if(finish) {
+            break;
+        }
+        if(nWritten == 0) {
+            std::unique_lock<std::mutex> lock(wakeLock);
+            wakeup.wait_for(lock, std::chrono::milliseconds(1));
+        }
+    }
+    fflush(out);
+}
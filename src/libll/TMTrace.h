@@ -0,0 +1,91 @@
+#ifndef TM_TRACE_H
+#define TM_TRACE_H
+
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Snippets.h"
+#include "libemul/Addressing.h"
+
+// Events of the binary transaction trace (the type of a TMTraceRecord)
+enum TMTraceEvent {
+    TMTRACE_REGION_BEGIN        = 1,  // tm_begin call (start of the atomic region)
+    TMTRACE_REGION_END          = 2,  // tm_end call (end of the atomic region)
+    TMTRACE_HTM_BEGIN           = 3,  // tm.begin started a transaction
+    TMTRACE_HTM_ABORT           = 4,  // The transaction aborted (abortType, aborter)
+    TMTRACE_HTM_COMMIT          = 5,  // tm.commit committed
+    TMTRACE_BEGIN_NACK          = 6,  // tm.begin delayed by the scheduler
+    TMTRACE_COMMIT_NACK         = 7,  // tm.commit lost commit arbitration
+    TMTRACE_LOCK_REQUEST        = 8,  // Fallback lock requested (arg is the fallback arg)
+    TMTRACE_LOCK_ACQUIRE        = 9,  // Fallback lock acquired
+    TMTRACE_LOCK_RELEASE        = 10, // Fallback lock released
+};
+
+// One event, 32 bytes little endian in the file. Read by scripts/tmtrace2json.py
+struct TMTraceRecord {
+    uint64_t    cycle;
+    uint64_t    utid;
+    uint32_t    pc;
+    uint32_t    arg;
+    int16_t     pid;
+    int16_t     aborter;
+    uint8_t     type;
+    // TMAbortType_e of an abort, 0xFF if there is none
+    uint8_t     abortType;
+    uint16_t    reserved;
+};
+
+///
+// Streaming binary trace of the transaction events seen at retire
+// (ThreadStats). The file starts with the magic "SESCTMT", a version byte and
+// the record size, followed by the records. Each thread appends to its own
+// ring buffer, and a writer thread drains the rings to the file, so neither
+// the memory nor the I/O grow with the length of the run. The records of a
+// thread are in order, the threads are interleaved in chunks. A full ring
+// stalls the simulator until the writer catches up.
+class TMTrace {
+public:
+    // Trace that ThreadStats writes, 0 if there is none
+    static TMTrace *active;
+
+    TMTrace(const char *fname, size_t ringSize);
+    // Drains the rings and closes the file
+    ~TMTrace();
+
+    void record(Pid_t pid, TMTraceEvent type, VAddr pc, uint64_t utid, uint32_t arg = 0,
+            uint32_t abortType = 0xFF, Pid_t aborter = INVALID_PID);
+
+    uint64_t getNumRecords() const { return nRecords; }
+    uint64_t getNumStalls() const  { return nStalls; }
+private:
+    struct Ring {
+        Ring(size_t n): recs(n), head(0), tail(0) {
+        }
+        std::vector<TMTraceRecord>  recs;
+        // Next record written by the simulator
+        std::atomic<uint64_t>       head;
+        // Next record written to the file
+        std::atomic<uint64_t>       tail;
+    };
+
+    Ring *getRing(Pid_t pid);
+    void writerLoop();
+    size_t drainRings();
+
+    FILE    *out;
+    size_t  ringSize;
+    // Only the simulator adds rings, the writer reads the list under ringsLock
+    std::vector<Ring *>     rings;
+    std::mutex              ringsLock;
+    std::mutex              wakeLock;
+    std::condition_variable wakeup;
+    std::atomic<bool>       done;
+    std::thread             writer;
+    uint64_t    nRecords;
+    uint64_t    nStalls;
+};
+
+#endif
@@ -20,15 +20,19 @@ Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
 #include "ThreadContext.h"
+#include "BBVProfile.h"
 #include "libemul/FileSys.h"
 #include "libcore/ProcessId.h"
 #include "libcore/DInst.h"
+#include "libcore/GProcessor.h"
 
 ThreadContext::ContextVector ThreadContext::pid2context;
 bool ThreadContext::ff;
 Time_t ThreadContext::resetTS = 0;
 std::set<uint32_t> ThreadContext::tmFallbackMutexCAddrs;
 bool ThreadContext::simDone = false;
+bool ThreadContext::warmSkip = false;
+bool ThreadContext::skipping = false;
 int64_t ThreadContext::finalSkip = 0;
 bool ThreadContext::inMain = false;
 
@@ -36,6 +40,7 @@ void InstContext::clear() {
     wasHit      = false;
     setConflict = false;
     wasNacked   = false;
+    skipBoundary= false;
     tmLat       = 0;
     tmArg       = 0;
     funcData.clear();
@@ -44,6 +49,8 @@ void InstContext::clear() {
     tmBeginSubtype=TM_BEGIN_INVALID;
     tmCommitSubtype=TM_COMMIT_INVALID;
     tmAbortType=TM_ATYPE_INVALID;
+    tmUtid      = INVALID_UTID;
+    tmAborterPid= INVALID_PID;
 }
 
 void ThreadContext::initialize() {
@@ -54,6 +61,7 @@ void ThreadContext::initialize() {
     tmContext   = NULL;
     tmDepth     = 0;
     tmlibUserTid= INVALID_USER_TID;
+    tmBeginSite = 0;
     tmMemopHadStalled = false;
 #endif
 
@@ -88,6 +96,11 @@ TMBCStatus ThreadContext::beginTransaction(InstDesc* inst) {
 
             break;
         }
+        case TMBC_NACK: {
+            // Delayed by the transaction scheduler, stall and retry tm.begin
+            startStalling(htmManager->getBeginRetryStallCycles());
+            break;
+        }
         default:
             fail("Unhanded TM begin");
     }
@@ -129,6 +142,11 @@ TMBCStatus ThreadContext::commitTransaction(InstDesc* inst) {
 
             break;
         }
+        case TMBC_NACK: {
+            // Commit arbitration failed (lazy model), stall and retry tm.commit
+            startStalling(htmManager->getNackRetryStallCycles(this));
+            break;
+        }
         default:
             fail("Unhanded TM commit");
     }
@@ -477,58 +495,260 @@ void ThreadContext::reap() {
     pid2context[pid]=0;
 }
 
-inline bool ThreadContext::skipInst(void) {
-    if(isSuspended())
-        return false;
-    if(isExited())
-        return false;
+///
+// Rabbit mode: run up to maxInsts InstDescs of this thread back to back. Each
+// InstDesc is still dispatched through its emul function; the loop only saves
+// the thread state checks (suspended, exited, end of fast-forward), which are
+// done when a run of straight-line InstDescs starts. The run follows the trace
+// while the InstDesc that just ran is chainable and left iDesc on the next
+// one, and ends at a branch, a trap, a redirect or retry, or after maxInsts. A
+// pending signal can stop the thread in any instruction, so runs are not
+// followed while one is ready. Signals do not become ready within a run, only
+// syscalls send them. The hook is called before (pre) and after (post) each
+// InstDesc.
+template<class Hook>
+inline int32_t ThreadContext::skipInstLoop(int32_t maxInsts, bool untilROI, Hook &hook) {
+    int32_t done=0;
+    while(done<maxInsts) {
+        if(untilROI&&!ff)
+            break;
+        if(suspSig||exited)
+            break;
+        bool chain=!hasReadySignal();
+        InstDesc *inst=iDesc;
+        do {
 #if (defined DEBUG_InstDesc)
-    iDesc->debug();
+            inst->debug();
 #endif
-    (*iDesc)(this);
-    return true;
+            hook.pre(this,inst);
+            (*inst)(this);
+            hook.post(this,inst);
+            done++;
+        } while(chain&&inst->chain&&(iDesc==++inst)&&(done<maxInsts));
+    }
+    return done;
+}
+
+// Plain fast-forward
+class SkipNoHook {
+public:
+    void pre(ThreadContext *context, const InstDesc *inst) {
+    }
+    void post(ThreadContext *context, const InstDesc *inst) {
+    }
+};
+
+// Counts the executed basic blocks in BBVProfile::active. A block ends when
+// the next InstDesc is not the one that follows in the trace.
+class SkipBBVHook {
+    BBVProfile        *profile;
+    BBVProfile::Block &block;
+    Pid_t              pid;
+public:
+    SkipBBVHook(BBVProfile *profile, Pid_t pid)
+        : profile(profile), block(profile->getBlock(pid)), pid(pid) {
+    }
+    void pre(ThreadContext *context, const InstDesc *inst) {
+        if(!block.len)
+            block.addr=context->getIAddr();
+    }
+    void post(ThreadContext *context, const InstDesc *inst) {
+        block.len++;
+        if(context->getIDesc()!=inst+1)
+            profile->endBlock(pid);
+    }
+};
+
+// Warms the caches and the branch predictor of the processor that runs the
+// thread (pid modulo the number of processors if it has not run yet) with
+// each instruction. Handlers and cuts have no SESC instruction. There is no
+// timing.
+class SkipWarmHook {
+    GProcessor *gproc;
+public:
+    SkipWarmHook(Pid_t pid) {
+        ProcessId *proc=ProcessId::getProcessId(pid);
+        CPU_t cpu=(proc&&proc->getCPU()>=0)?proc->getCPU():(pid%osSim->getNumCPUs());
+        gproc=osSim->id2GProcessor(cpu);
+    }
+    void pre(ThreadContext *context, const InstDesc *inst) {
+    }
+    void post(ThreadContext *context, const InstDesc *inst) {
+        if(inst->sescInst)
+            gproc->warm(inst->sescInst,context->getIAddr(),context->getDAddr());
+        context->setDAddr(0);
+    }
+};
+
+int32_t ThreadContext::skipInstBlock(int32_t maxInsts, bool untilROI) {
+    int32_t done;
+    if(BBVProfile::active) {
+        SkipBBVHook hook(BBVProfile::active,pid);
+        done=skipInstLoop(maxInsts,untilROI,hook);
+    } else if(warmSkip) {
+        SkipWarmHook hook(pid);
+        done=skipInstLoop(maxInsts,untilROI,hook);
+    } else {
+        SkipNoHook hook;
+        done=skipInstLoop(maxInsts,untilROI,hook);
+    }
+    if(done>0) {
+        // The skipped instructions have no DInst: drop their function
+        // boundaries and tell ThreadStats where the skip is
+        clearInstContext();
+        instContext.skipBoundary=true;
+    }
+    return done;
 }
 
 int64_t ThreadContext::skipInsts(int64_t skipCount) {
     int64_t skipped=0;
     int nowPid=0;
+    skipping=true;
     if(skipCount<0) {
         ThreadContext::ff = true;
         while(ThreadContext::ff) {
             nowPid=nextReady(nowPid);
             if(nowPid==-1)
-                return skipped;
+                break;
             ThreadContext* context=pid2context[nowPid];
             I(context);
             I(!context->isSuspended());
             I(!context->isExited());
-			int nowSkip = 500;
-            while(nowSkip&&ThreadContext::ff&&context->skipInst()) {
-				nowSkip--;
-                skipped++;
-            }
+            skipped+=context->skipInstBlock(500,true);
             nowPid++;
 		}
     } else {
         while(skipped<skipCount) {
             nowPid=nextReady(nowPid);
             if(nowPid==-1)
-                return skipped;
+                break;
             ThreadContext* context=pid2context[nowPid];
             I(context);
             I(!context->isSuspended());
             I(!context->isExited());
             int nowSkip=(skipCount-skipped<500)?(skipCount-skipped):500;
-            while(nowSkip&&context->skipInst()) {
-                nowSkip--;
-                skipped++;
-            }
+            skipped+=context->skipInstBlock(nowSkip,false);
             nowPid++;
         }
     }
+    skipping=false;
     return skipped;
 }
 
+void ThreadContext::save(ChkWriter &out) const {
+    out << "Tid " << tid << " Tgid " << tgid << " ExitSig " << exitSig << endl;
+    out << "Stack " << myStackAddrLb << " " << myStackAddrUb;
+    out << " ClearTid " << clear_child_tid << " Robust " << robust_list << endl;
+    out << "IAddr " << iAddr << " SigMask " << sigMask << " Spin " << spinning << endl;
+#if (defined TM)
+    out << "TMTid " << tmlibUserTid << endl;
+#endif
+    out.write(reinterpret_cast<const char *>(regs),sizeof(regs));
+    out << endl;
+    out << "RetHandlers " << retHandlers.size() << endl;
+    for(size_t i=0; i<retHandlers.size(); i++)
+        out << retHandlers[i].first << " " << retHandlerToId(retHandlers[i].second) << endl;
+}
+
+void ThreadContext::restore(ChkReader &in) {
+    int _tid, _tgid;
+    size_t _exitSig;
+    in >> "Tid " >> _tid >> " Tgid " >> _tgid >> " ExitSig " >> _exitSig >> endl;
+    if((_tid!=tid)||(_tgid!=tgid))
+        fail("ThreadContext::restore thread %d (group %d) restored as %d (group %d)\n",_tid,_tgid,tid,tgid);
+    exitSig=static_cast<SignalID>(_exitSig);
+    in >> "Stack " >> myStackAddrLb >> " " >> myStackAddrUb;
+    in >> " ClearTid " >> clear_child_tid >> " Robust " >> robust_list >> endl;
+    VAddr _iAddr;
+    in >> "IAddr " >> _iAddr >> " SigMask " >> sigMask >> " Spin " >> spinning >> endl;
+#if (defined TM)
+    in >> "TMTid " >> tmlibUserTid >> endl;
+#endif
+    in.read(reinterpret_cast<char *>(regs),sizeof(regs));
+    in >> endl;
+    size_t _retHandlers;
+    in >> "RetHandlers " >> _retHandlers >> endl;
+    retHandlers.clear();
+    retHandlersSaved.clear();
+    for(size_t i=0; i<_retHandlers; i++) {
+        VAddr _addr;
+        size_t _id;
+        in >> _addr >> " " >> _id >> endl;
+        retHandlers.push_back(std::make_pair(_addr,idToRetHandler(_id)));
+    }
+    // Decodes the instruction, so the address space must be restored by now
+    setIAddr(_iAddr);
+}
+
+///
+// Only a single process whose threads all share one address space, one file
+// table and one signal table can be saved. Threads must not be in a
+// transaction, and can only be suspended on a futex.
+void ThreadContext::saveThreads(ChkWriter &out) {
+    ThreadContext *mainContext=getMainThreadContext();
+    for(size_t i=0; i<pid2context.size(); i++) {
+        ThreadContext *context=pid2context[i];
+        if((!context)||context->isExited())
+            fail("ThreadContext::saveThreads thread %d has exited\n",(int)i);
+        if((context->getAddressSpace()!=mainContext->getAddressSpace())||
+                (context->getOpenFiles()!=mainContext->getOpenFiles())||
+                (context->getSignalTable()!=mainContext->getSignalTable()))
+            fail("ThreadContext::saveThreads thread %d is not in the main process\n",(int)i);
+        if((!context->readySig.empty())||(!context->maskedSig.empty()))
+            fail("ThreadContext::saveThreads thread %d has pending signals\n",(int)i);
+#if (defined TM)
+        if(context->isInTM())
+            fail("ThreadContext::saveThreads thread %d is in a transaction\n",(int)i);
+#endif
+    }
+    out << "Threads " << pid2context.size() << endl;
+    out << "InMain " << inMain << endl;
+#if (defined TM)
+    out << "FallbackMutexes " << tmFallbackMutexCAddrs.size() << endl;
+    for(std::set<uint32_t>::const_iterator it=tmFallbackMutexCAddrs.begin(); it!=tmFallbackMutexCAddrs.end(); it++)
+        out << *it << endl;
+#endif
+    mainContext->getAddressSpace()->save(out);
+    mainContext->getOpenFiles()->save(out);
+    mainContext->getSignalTable()->save(out);
+    for(size_t i=0; i<pid2context.size(); i++)
+        pid2context[i]->save(out);
+    LinuxSys::saveFutexes(out);
+}
+
+///
+// Restores the threads on top of a freshly loaded main thread of the same
+// executable (same arguments), before any instruction is executed.
+void ThreadContext::restoreThreads(ChkReader &in) {
+    if(pid2context.size()!=1)
+        fail("ThreadContext::restoreThreads called after threads were created\n");
+    ThreadContext *mainContext=getMainThreadContext();
+    size_t _threads;
+    in >> "Threads " >> _threads >> endl;
+    in >> "InMain " >> inMain >> endl;
+#if (defined TM)
+    size_t _fallbackMutexes;
+    in >> "FallbackMutexes " >> _fallbackMutexes >> endl;
+    for(size_t i=0; i<_fallbackMutexes; i++) {
+        uint32_t _caddr;
+        in >> _caddr >> endl;
+        tmFallbackMutexCAddrs.insert(_caddr);
+    }
+#endif
+    mainContext->getAddressSpace()->restore(in);
+    mainContext->getOpenFiles()->restore(in);
+    mainContext->getSignalTable()->restore(in);
+    // The other threads are created as sysClone does for pthread_create
+    for(size_t i=1; i<_threads; i++) {
+        ThreadContext *newContext=new ThreadContext(*mainContext,false,true,false,true,true,true,true,SigNone,0);
+        osSim->eventSpawn(-1,newContext->gettid(),0);
+    }
+    for(size_t i=0; i<_threads; i++)
+        pid2context[i]->restore(in);
+    LinuxSys::restoreFutexes(in);
+}
+
 void ThreadContext::writeMemFromBuf(VAddr addr, size_t len, const void *buf) {
     I(canWrite(addr,len));
     const uint8_t *byteBuf=(uint8_t *)buf;
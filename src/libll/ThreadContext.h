@@ -54,6 +54,8 @@ public:
     bool wasHit;
     bool setConflict;
     bool wasNacked;
+    // First instruction after a fast-forward of the thread (skipInsts)
+    bool skipBoundary;
     // Cycles for stalling retire of a tm instruction
     uint32_t    tmLat;
     // User-passed HTM command arg
@@ -65,6 +67,9 @@ public:
     TMBeginSubtype tmBeginSubtype;
     TMCommitSubtype tmCommitSubtype;
     TMAbortType_e  tmAbortType;
+    // Transaction of the tm instruction, and who aborted it (complete abort)
+    uint64_t    tmUtid;
+    Pid_t       tmAborterPid;
 };
 
 // Use this define to debug the simulated application
@@ -76,6 +81,10 @@ public:
     typedef SmartPtr<ThreadContext> pointer;
     static bool ff;
     static bool simDone;
+    // skipInsts warms the caches and branch predictors (warmFastForward)
+    static bool warmSkip;
+    // True while skipInsts runs the threads (no timing, globalClock stands still)
+    static bool skipping;
 	static int64_t finalSkip;
     static Time_t resetTS;
 
@@ -90,6 +99,8 @@ private:
     // Debug flag for making sure we have consistent view of SW tid and HW tid
     uint32_t tmlibUserTid;
 #define INVALID_USER_TID (0xDEADDEAD)
+    // Call instruction of the last tm_begin (0 if there is none)
+    VAddr   tmBeginSite;
     // Saved thread context
     TMContext *tmContext;
     // Depth of nested transactions
@@ -178,6 +189,8 @@ public:
 
     // Transactional Methods
     void setTMlibUserTid(uint32_t arg);
+    void setTMBeginSite(VAddr site) { tmBeginSite = site; }
+    VAddr getTMBeginSite() const { return tmBeginSite; }
 
     TMBCStatus beginTransaction(InstDesc* inst);
     TMBCStatus commitTransaction(InstDesc* inst);
@@ -220,6 +233,9 @@ public:
     bool checkStall() const {
         return stallUntil != 0 && stallUntil >= globalClock;
     }
+    Time_t getStallUntil() const {
+        return stallUntil;
+    }
     void startRetryTimer() {
         tmMemopHadStalled = true;
         startStalling(htmManager->getNackRetryStallCycles(this));
@@ -378,8 +394,16 @@ public:
         } while(foundPid!=startPid);
         return -1;
     }
-    inline bool skipInst(void);
+    template<class Hook>
+    inline int32_t skipInstLoop(int32_t maxInsts, bool untilROI, Hook &hook);
+    int32_t skipInstBlock(int32_t maxInsts, bool untilROI);
     static int64_t skipInsts(int64_t skipCount);
+    // Checkpointing of all the threads of the simulated process, with its
+    // memory, open files and futex waiters (see OSSim -c save:/load:)
+    static void saveThreads(ChkWriter &out);
+    static void restoreThreads(ChkReader &in);
+    void save(ChkWriter &out) const;
+    void restore(ChkReader &in);
 #if (defined HAS_MEM_STATE)
     inline const MemState &getState(VAddr addr) const {
         return addressSpace->getState(addr);
@@ -2,10 +2,20 @@
 #include "ThreadContext.h"
 #include "ReportGen.h"
 #include "ThreadStats.h"
+#include "TMTrace.h"
 
 using namespace std;
 HASH_MAP<Pid_t, ThreadStats> ThreadStats::threadStats;
 
+/// Add the event of a retired instruction to the transaction trace, if any
+static void traceEvent(DInst* dinst, TMTraceEvent type, uint32_t arg = 0) {
+    if(TMTrace::active) {
+        const InstContext& instContext = dinst->getInstContext();
+        TMTrace::active->record(dinst->context->getPid(), type, dinst->getInst()->getAddr(),
+                instContext.tmUtid, arg, instContext.tmAbortType, instContext.tmAborterPid);
+    }
+}
+
 AtomicRegionStats::AtomicRegionStats():
     duration(0),
     inMutex(0),
@@ -91,13 +101,16 @@ void AtomicRegionContext::markRetireFuncBoundary(DInst* dinst, const FuncBoundar
         case FUNC_TM_BEGIN_FALLBACK:
             if(funcData.isCall) {
                 newAREvent(AR_EVENT_LOCK_REQUEST);
+                traceEvent(dinst, TMTRACE_LOCK_REQUEST, funcData.arg1);
             } else {
                 newAREvent(AR_EVENT_LOCK_ACQUIRE);
+                traceEvent(dinst, TMTRACE_LOCK_ACQUIRE);
             }
             break;
         case FUNC_TM_END_FALLBACK:
             if(funcData.isCall) {
                 newAREvent(AR_EVENT_LOCK_RELEASE);
+                traceEvent(dinst, TMTRACE_LOCK_RELEASE);
             }
             break;
         case FUNC_TM_WAIT:
@@ -127,10 +140,16 @@ void AtomicRegionContext::markRetireTM(DInst* dinst) {
 
     if(dinst->tmAbortCompleteOp()) {
         newAREvent(AR_EVENT_HTM_ABORT);
+        traceEvent(dinst, TMTRACE_HTM_ABORT);
     } else if(dinst->tmBeginOp()) {
         switch(dinst->getTMBeginSubtype()) {
             case TM_BEGIN_REGULAR:
                 newAREvent(AR_EVENT_HTM_BEGIN);
+                traceEvent(dinst, TMTRACE_HTM_BEGIN);
+                break;
+            case TM_BEGIN_NACKED:
+                // tm.begin is executed again after the stall
+                traceEvent(dinst, TMTRACE_BEGIN_NACK);
                 break;
             default:
                 fail("Unhandled tmBeginSubtype: %d\n", dinst->getTMBeginSubtype());
@@ -139,9 +158,15 @@ void AtomicRegionContext::markRetireTM(DInst* dinst) {
         switch(dinst->getTMCommitSubtype()) {
             case TM_COMMIT_REGULAR:
                 newAREvent(AR_EVENT_HTM_COMMIT);
+                traceEvent(dinst, TMTRACE_HTM_COMMIT);
                 break;
             case TM_COMMIT_ABORTED:
                 newAREvent(AR_EVENT_HTM_ABORT);
+                traceEvent(dinst, TMTRACE_HTM_ABORT);
+                break;
+            case TM_COMMIT_NACKED:
+                // tm.commit is executed again after the stall
+                traceEvent(dinst, TMTRACE_COMMIT_NACK);
                 break;
             default:
                 fail("Unhandled tmCommitSubtype: %d\n", dinst->getTMCommitSubtype());
@@ -316,13 +341,19 @@ void ThreadStats::initialize(Pid_t pid) {
 void ThreadStats::report(const char* str) {
     Report::field("BEGIN ThreadStats::report %s", str);
     AtomicRegionStats allStats;
+    size_t nRegionsBeforeSkip = 0;
+    size_t nRegionsAfterSkip  = 0;
 
     HASH_MAP<Pid_t, ThreadStats>::const_iterator iStats;
     for(iStats = threadStats.begin(); iStats != threadStats.end(); ++iStats) {
         allStats.sum(iStats->second.regionStats);
+        nRegionsBeforeSkip += iStats->second.nRegionsBeforeSkip;
+        nRegionsAfterSkip  += iStats->second.nRegionsAfterSkip;
     }
 
     allStats.reportValues();
+    Report::field("tt_partialRegionsBeforeSkip=%lu", nRegionsBeforeSkip);
+    Report::field("tt_partialRegionsAfterSkip=%lu",  nRegionsAfterSkip);
     Report::field("END ThreadStats::report %s", str);
 }
 
@@ -335,6 +366,17 @@ void ThreadStats::markRetire(DInst* dinst) {
     // Everything below is working on myStats as `this'
     myStats.nRetiredInsts++;
 
+    // A skip cuts the atomic region around it: the part simulated in detail
+    // is discarded, and so is the rest of any region the thread is in after
+    // the skip (until its next tm_begin)
+    if(dinst->getInstContext().skipBoundary) {
+        if(myStats.currentRegion.isOpen()) {
+            myStats.nRegionsBeforeSkip++;
+        }
+        myStats.currentRegion.clear();
+        myStats.afterSkip = true;
+    }
+
     if(inst->isTM()) {
         myStats.currentRegion.markRetireTM(dinst);
     }
@@ -349,8 +391,17 @@ void ThreadStats::markRetire(DInst* dinst) {
         switch(i_funcData->funcName) {
             case FUNC_TM_BEGIN:
                 myStats.currentRegion.init(pid, dinst->getInst()->getAddr(), globalClock);
+                myStats.afterSkip = false;
+                traceEvent(dinst, TMTRACE_REGION_BEGIN);
                 break;
             case FUNC_TM_END: {
+                traceEvent(dinst, TMTRACE_REGION_END);
+                if(myStats.afterSkip) {
+                    myStats.nRegionsAfterSkip++;
+                    myStats.currentRegion.clear();
+                    myStats.afterSkip = false;
+                    break;
+                }
                 AtomicRegionStats currentStats;
                 myStats.currentRegion.markEnd(globalClock);
                 myStats.currentRegion.calculate(&currentStats);
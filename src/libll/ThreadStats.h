@@ -68,6 +68,9 @@ public:
     void markEnd(Time_t at) {
         endAt = at;
     }
+    bool isOpen() const {
+        return startPC != 0;
+    }
     void printEvents(const AtomicRegionEvents& current) const;
     void markRetireFuncBoundary(DInst* dinst, const FuncBoundaryData& funcData);
     void markRetireTM(DInst* dinst);
@@ -90,7 +93,8 @@ private:
 
 class ThreadStats {
 public:
-    ThreadStats(): nRetiredInsts(0), nExedInsts(0), prevDInstRetired(0) {}
+    ThreadStats(): nRetiredInsts(0), nExedInsts(0), prevDInstRetired(0),
+        afterSkip(false), nRegionsBeforeSkip(0), nRegionsAfterSkip(0) {}
     static void initialize(Pid_t pid);
     static void markRetire(DInst* dinst);
     static void incNExedInsts(Pid_t pid) {
@@ -120,6 +124,13 @@ private:
     size_t    nExedInsts;
     // Time when the previous DInst for this thread had retired
     Time_t    prevDInstRetired;
+    // The thread was fast-forwarded and has not started a region since, so
+    // it may be in the middle of one
+    bool      afterSkip;
+    // Atomic regions cut by a skip and left out of regionStats: open when
+    // the skip started, and ended after it without a detailed begin
+    size_t    nRegionsBeforeSkip;
+    size_t    nRegionsAfterSkip;
 };
 
 #endif
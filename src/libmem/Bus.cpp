@@ -97,6 +97,11 @@ void Bus::invalidate(PAddr addr,ushort size,MemObj *oc)
     invUpperLevel(addr,size,oc);
 }
 
+void Bus::warm(PAddr addr, bool isWrite)
+{
+    lowerLevel[0]->warm(addr, isWrite);
+}
+
 Time_t Bus::getNextFreeCycle() const
 {
     return cmdPort->calcNextSlot();
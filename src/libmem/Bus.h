@@ -44,6 +44,7 @@ public:
     void returnAccess(MemRequest *mreq);
     bool canAcceptStore(PAddr addr);
     void invalidate(PAddr addr,ushort size,MemObj *oc);
+    void warm(PAddr addr, bool isWrite);
     Time_t getNextFreeCycle() const;
 };
 
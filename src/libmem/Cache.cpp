@@ -616,6 +616,43 @@ bool Cache::isInCache(PAddr addr) const
     return false;
 }
 
+///
+// Fill the line without a request: a miss warms the lower level, and a dirty
+// victim is written back to it. Lines with a miss in flight are left alone,
+// and an inclusive cache below the first level does not evict (that would
+// have to invalidate the upper levels).
+void Cache::warm(PAddr addr, bool isWrite)
+{
+    CacheType *bank = getCacheBank(addr);
+    Line *l = bank->findLineNoEffect(addr);
+    if(l) {
+        if(isWrite && !l->isLocked())
+            l->makeDirty();
+        return;
+    }
+
+    if(getBankMSHR(addr)->hasEntry(addr))
+        return;
+
+    l = bank->findLine2Replace(addr);
+    if(l == 0)
+        return;
+
+    if(l->isValid()) {
+        if(inclusiveCache && !isHighestLevel())
+            return;
+        if(l->isDirty())
+            lowerLevel[0]->warm(bank->calcAddr4Tag(l->getTag()), true);
+        l->invalidate();
+    }
+    l->setTag(bank->calcTag(addr));
+    l->validate();
+    if(isWrite)
+        l->makeDirty();
+
+    lowerLevel[0]->warm(addr, false);
+}
+
 void Cache::invalidate(PAddr addr, ushort size, MemObj *lowerCache)
 {
     I(lowerCache);
@@ -890,6 +927,14 @@ void WTCache::pushLine(MemRequest *mreq)
     I(0); // should never be called
 }
 
+void WTCache::warm(PAddr addr, bool isWrite)
+{
+    // The lines are never dirty, writes go down
+    Cache::warm(addr, false);
+    if(isWrite)
+        lowerLevel[0]->warm(addr, true);
+}
+
 void WTCache::doReturnAccess(MemRequest *mreq)
 {
     PAddr addr = mreq->getPAddr();
@@ -297,6 +297,8 @@ public:
 
     bool isInCache(PAddr addr) const;
 
+    void warm(PAddr addr, bool isWrite);
+
     // same as above plus schedule callback to doInvalidate
     void invalidate(PAddr addr, ushort size, MemObj *oc);
     void doInvalidate(PAddr addr, ushort size);
@@ -361,6 +363,7 @@ public:
     ~WTCache();
 
     void pushLine(MemRequest *mreq);
+    void warm(PAddr addr, bool isWrite);
 };
 
 class SVCache : public WBCache {
@@ -400,6 +403,9 @@ public:
     void pushLine(MemRequest *mreq);
     void returnAccess(MemRequest *mreq);
     void specialOp(MemRequest *mreq);
+    void warm(PAddr addr, bool isWrite) {
+        // always hits
+    }
 };
 
 
@@ -181,6 +181,11 @@ void PriorityBus::invalidate(PAddr addr,ushort size,MemObj *oc)
     invUpperLevel(addr,size,oc);
 }
 
+void PriorityBus::warm(PAddr addr, bool isWrite)
+{
+    lowerLevel[0]->warm(addr, isWrite);
+}
+
 Time_t PriorityBus::getNextFreeCycle() const
 {
     return busPort->calcNextSlot();
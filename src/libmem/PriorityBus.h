@@ -90,6 +90,7 @@ public:
 
     bool canAcceptStore(PAddr addr);
     void invalidate(PAddr addr,ushort size,MemObj *oc);
+    void warm(PAddr addr, bool isWrite);
     Time_t getNextFreeCycle() const;
 };
 #endif
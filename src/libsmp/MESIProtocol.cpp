@@ -83,6 +83,30 @@ void MESIProtocol::preInvalidate(Line *l)
         changeState(l, MESI_TRANS_INV);
 }
 
+// functional warm-up: l was filled (or is upgraded for a write) without
+// going through the bus, shared tells if other caches kept a copy
+void MESIProtocol::warmFill(Line *l, bool isWrite, bool shared)
+{
+    I(!l->isLocked());
+
+    if(isWrite)
+        l->changeStateTo(MESI_MODIFIED);
+    else
+        l->changeStateTo(shared ? MESI_SHARED : MESI_EXCLUSIVE);
+}
+
+// another cache warms the line: a write invalidates it, a read takes away
+// the exclusivity
+void MESIProtocol::warmSnoop(Line *l, bool isWrite)
+{
+    I(!l->isLocked());
+
+    if(isWrite)
+        l->invalidate();
+    else if(l->getState() != MESI_SHARED)
+        l->changeStateTo(MESI_SHARED);
+}
+
 void MESIProtocol::read(MemRequest *mreq)
 {
     PAddr addr = mreq->getPAddr();
@@ -59,6 +59,9 @@ public:
     void makeDirty(Line *l);
     void preInvalidate(Line *l);
 
+    void warmFill(Line *l, bool isWrite, bool shared);
+    void warmSnoop(Line *l, bool isWrite);
+
     void read(MemRequest *mreq);
     void doRead(MemRequest *mreq);
     typedef CallbackMember1<MESIProtocol, MemRequest *,
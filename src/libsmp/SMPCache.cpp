@@ -446,6 +446,55 @@ void SMPCache::realInvalidate(PAddr addr, ushort size, bool writeBack)
     }
 }
 
+///
+// Functional warm-up. Misses and upgrades are snooped by the other caches on
+// the bus, and the line is filled with the state MESI would give it. Lines
+// with a request in flight keep their state. Only first level caches warm
+// (an eviction below them would have to invalidate the upper levels).
+void SMPCache::warm(PAddr addr, bool isWrite)
+{
+    if(!isHighestLevel())
+        return;
+    if(outsReq->hasEntry(addr) || mutExclBuffer->hasEntry(addr))
+        return;
+
+    Line *l = cache->findLine(addr);
+    if(l) {
+        if(l->isLocked() || !isWrite || l->isDirty())
+            return;
+    } else {
+        l = cache->findLine2Replace(addr);
+        if(!l)
+            return;
+        if(l->isValid()) {
+            if(l->isDirty())
+                lowerLevel[0]->warm(cache->calcAddr4Tag(l->getTag()), true);
+            l->invalidate();
+        }
+        l->setTag(cache->calcTag(addr));
+        lowerLevel[0]->warm(addr, false);
+    }
+
+    bool shared = false;
+    const LevelType *peers = lowerLevel[0]->getUpperLevel();
+    for(uint32_t i = 0; i < peers->size(); i++) {
+        if((*peers)[i] != this)
+            shared |= (*peers)[i]->warmSnoop(addr, isWrite);
+    }
+
+    protocol->warmFill(l, isWrite, shared);
+}
+
+bool SMPCache::warmSnoop(PAddr addr, bool isWrite)
+{
+    Line *l = cache->findLineNoEffect(addr);
+    if(!l || l->isLocked() || !isHighestLevel())
+        return l != 0;
+
+    protocol->warmSnoop(l, isWrite);
+    return true;
+}
+
 // interface with protocol
 
 // sends a request to lower level
@@ -174,6 +174,9 @@ public:
     void doInvalidate(PAddr addr, ushort size);
     void realInvalidate(PAddr addr, ushort size, bool writeBack);
 
+    void warm(PAddr addr, bool isWrite);
+    bool warmSnoop(PAddr addr, bool isWrite);
+
     // END MemObj interface
 
     // BEGIN protocol interface
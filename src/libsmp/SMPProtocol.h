@@ -67,6 +67,14 @@ public:
     virtual void write(MemRequest *mreq);
     virtual void writeBack(MemRequest *mreq);
     virtual void returnAccess(MemRequest *mreq);
+
+    // functional warm-up (SMPCache::warm), no messages are sent
+    virtual void warmFill(Line *l, bool isWrite, bool shared) {
+        I(0);
+    }
+    virtual void warmSnoop(Line *l, bool isWrite) {
+        I(0);
+    }
     // END interface with cache
 
     // BEGIN interface of Protocol
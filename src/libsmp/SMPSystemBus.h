@@ -90,6 +90,11 @@ public:
     void invalidate(PAddr addr, ushort size, MemObj *oc);
     void doInvalidate(PAddr addr, ushort size);
 
+    // The caches snoop the warm-up accesses themselves (SMPCache::warm)
+    void warm(PAddr addr, bool isWrite) {
+        lowerLevel[0]->warm(addr, isWrite);
+    }
+
     bool canAcceptStore(PAddr addr) {
         return true;
     }
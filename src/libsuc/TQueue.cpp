@@ -51,6 +51,15 @@ exportTemplate template < class Data, class Time> void TQueue < Data, Time >
     minPos = 0;
 
     minTooFar   = MaxTime;              // MaxTime means empty
+
+#ifdef TQUEUE_WHEEL
+    bzero(wheelHead, sizeof(wheelHead));
+    bzero(wheelTail, sizeof(wheelTail));
+    bzero(wheelUsed, sizeof(wheelUsed));
+
+    nTooFar   = 0;
+    wheelTime = AccessSize - 1;
+#endif
 }
 
 exportTemplate template < class Data, class Time > TQueue < Data, Time >
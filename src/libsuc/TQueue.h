@@ -36,6 +36,8 @@ Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  * MaxTimeDiff. Otherways, an additional slowdown would be suffered because
  * heaps would be used.
  *
+ * When compiled with TQUEUE_WHEEL, the distant tasks go to a hierarchical
+ * timing wheel instead of the heap (O(1) insert/extract at any distance).
  */
 
 template < class Data, class Time > class TQueue {
@@ -105,6 +107,166 @@ private:
     Data *access;
     Data *accessTail;
 
+#ifdef TQUEUE_WHEEL
+    // Hierarchical timing wheel for the nodes that do not fit in the access
+    // window. Level l has WheelSlots slots, each one covering
+    // WheelSlots^l cycles. A node is filed in the highest level where its
+    // time and wheelTime differ, so nodes move down (in FIFO order) when
+    // wheelTime enters their slot.
+    enum {
+        WheelBits   = 6,
+        WheelSlots  = 1 << WheelBits,
+        WheelMask   = WheelSlots - 1,
+        WheelLevels = (sizeof(Time) * 8 + WheelBits - 1) / WheelBits
+    };
+
+    Data wheelHead[WheelLevels][WheelSlots];
+    Data wheelTail[WheelLevels][WheelSlots];
+    uint64_t wheelUsed[WheelLevels];
+
+    int32_t nTooFar;
+    // All the nodes in the wheel have time >= wheelTime
+    Time wheelTime;
+
+    // Lower bound of the time of the first node in the wheel
+    Time minTooFar;
+
+    int32_t wheelLevel(Time time) const {
+        Time diff = (time ^ wheelTime) >> WheelBits;
+        int32_t l = 0;
+        while (diff) {
+            diff >>= WheelBits;
+            l++;
+        }
+        return l;
+    };
+
+    static uint32_t wheelSlot(Time time, int32_t l) {
+        return ((uint32_t)(time >> (l * WheelBits))) & WheelMask;
+    };
+
+    static Time wheelSlotStart(Time time, int32_t l) {
+        return time & ~((((Time)1) << (l * WheelBits)) - 1);
+    };
+
+    void addTooFar(Data node) {
+        Time time = node->getTQTime();
+        I(time >= wheelTime);
+
+        int32_t  l = wheelLevel(time);
+        uint32_t s = wheelSlot(time, l);
+
+        if(wheelHead[l][s] == 0) {
+            wheelHead[l][s] = node;
+            wheelUsed[l] |= ((uint64_t)1) << s;
+        } else {
+            wheelTail[l][s]->setTQNext(node);
+        }
+        wheelTail[l][s] = node;
+        node->setInTooFarQueue();
+        node->setTQNext(0);
+        nTooFar++;
+
+        Time start = wheelSlotStart(time, l);
+        if(minTooFar > start)
+            minTooFar = start;
+    };
+
+    // Returns the start time of the first used slot, and its position
+    Time firstTooFar(int32_t &l, uint32_t &s) const {
+        s = 0;
+        for(l = 0; l < WheelLevels; l++) {
+            uint64_t used = wheelUsed[l] & ((~(uint64_t)0) << wheelSlot(wheelTime, l));
+            if(used == 0)
+                continue;
+
+            s = __builtin_ctzll(used);
+
+            Time start = ((Time)s) << (l * WheelBits);
+            if(l + 1 < WheelLevels)
+                start |= wheelTime & ~((((Time)1) << ((l + 1) * WheelBits)) - 1);
+            return start;
+        }
+        // Empty wheel, callers check nTooFar first
+        I(0);
+        l = 0;
+        return MaxTime;
+    };
+
+    // Moves to the access window all the nodes with time < minTime + AccessSize
+    void adjustTooFar() {
+        Time limit = minTime + AccessSize;
+
+        while (nTooFar) {
+            int32_t  l;
+            uint32_t s;
+            Time start = firstTooFar(l, s);
+            if(start >= limit)
+                break;
+
+            if(start > wheelTime)
+                wheelTime = start;
+
+            Data node = wheelHead[l][s];
+            wheelHead[l][s] = 0;
+            wheelUsed[l] &= ~(((uint64_t)1) << s);
+
+            while (node) {
+                Data next = node->getTQNext();
+                nTooFar--;
+                if(l == 0)
+                    addNode(node, node->getTQTime());
+                else
+                    addTooFar(node);
+                node = next;
+            }
+        }
+
+        if(wheelTime < limit - 1)
+            wheelTime = limit - 1;
+
+        if(nTooFar) {
+            int32_t  l;
+            uint32_t s;
+            minTooFar = firstTooFar(l, s);
+        } else {
+            minTooFar = MaxTime;
+        }
+    };
+
+    void removeTooFar(Data node) {
+        Time time = node->getTQTime();
+
+        int32_t  l = wheelLevel(time);
+        uint32_t s = wheelSlot(time, l);
+
+        Data prev = 0;
+        Data curr = wheelHead[l][s];
+        while( curr != node ) {
+            I(curr);
+            prev = curr;
+            curr = curr->getTQNext();
+        }
+
+        if( prev == 0 )
+            wheelHead[l][s] = node->getTQNext();
+        else
+            prev->setTQNext(node->getTQNext());
+
+        if( wheelTail[l][s] == node )
+            wheelTail[l][s] = prev;
+
+        if( wheelHead[l][s] == 0 )
+            wheelUsed[l] &= ~(((uint64_t)1) << s);
+
+        nTooFar--;
+        node->removeFromQueue();
+    };
+
+    bool tooFarReady(Time cTime) const {
+        return minTooFar < minTime + AccessSize;
+    };
+#else
     class DLess {
     public:
         bool operator() (const Data x, const Data y) const {
@@ -116,6 +278,19 @@ private:
 
     Time minTooFar;
 
+    void addTooFar(Data data) {
+        // Some nodes already exists, and this is too distant in
+        // time.
+        Time time = data->getTQTime();
+        data->setInTooFarQueue();
+
+        tooFar.push_back(data);
+        std::push_heap(tooFar.begin(),tooFar.end(),dLess);
+
+        if(minTooFar > time)
+            minTooFar = time;
+    };
+
     void adjustTooFar() {
 
         I(!tooFar.empty());
@@ -136,6 +311,33 @@ private:
         minTooFar = tooFar.front()->getTQTime();
     };
 
+
+    void removeTooFar(Data node) {
+        if( tooFar.front() == node ) {
+            std::pop_heap(tooFar.begin(),tooFar.end(),dLess);
+            tooFar.pop_back();
+
+            if( tooFar.empty() )
+                minTooFar = MaxTime;
+            else
+                minTooFar = tooFar.front()->getTQTime();
+
+        } else {
+            typedef typename std::vector<Data>::iterator DataIter;
+            DataIter it = std::find(tooFar.begin(),tooFar.end(),node);
+
+            I(it != tooFar.end());
+            tooFar.erase(it);
+            I(std::find(tooFar.begin(),tooFar.end(),node) == tooFar.end());
+            std::make_heap(tooFar.begin(),tooFar.end(),dLess);
+        }
+    };
+
+    bool tooFarReady(Time cTime) const {
+        return minTooFar <= cTime;
+    };
+#endif
+
     void addNode(Data node, Time time) {
         I(time >= minTime);
         I((unsigned)abs((int)(time - minTime)) < AccessSize);
@@ -169,15 +371,7 @@ public:
         if((uint32_t)(time - minTime) < AccessSize) {
             addNode(data, time);
         } else {
-            // Some nodes already exists, and this is too distant in
-            // time.
-            data->setInTooFarQueue();
-
-            tooFar.push_back(data);
-            std::push_heap(tooFar.begin(),tooFar.end(),dLess);
-
-            if(minTooFar > time)
-                minTooFar = time;
+            addTooFar(data);
         }
     };
 
@@ -191,7 +385,19 @@ public:
             return node;
         }
 
-        if(minTooFar <= cTime)
+#ifdef TQUEUE_WHEEL
+        if(nNodes == 0) {
+            minTime = cTime;
+            minPos = 0;
+        }
+
+        if(tooFarReady(cTime))
+            adjustTooFar();
+
+        if(nNodes == 0)
+            return 0;
+#else
+        if(tooFarReady(cTime))
             adjustTooFar();
 
         if(nNodes == 0) {
@@ -199,12 +405,17 @@ public:
             minPos = 0;
             return 0;
         }
+#endif
 
         Data node = access[minPos];
 
         while (node == 0 && minTime < cTime) {
             minPos = (minPos + 1) & AccessMask;
             minTime++;
+#ifdef TQUEUE_WHEEL
+            if(tooFarReady(cTime))
+                adjustTooFar();
+#endif
             node = access[minPos];
         }
 
@@ -223,24 +434,7 @@ public:
 
     void remove(Data node) {
         if( node->isInTooFarQueue() ) {
-            if( tooFar.front() == node ) {
-                std::pop_heap(tooFar.begin(),tooFar.end(),dLess);
-                tooFar.pop_back();
-
-                if( tooFar.empty() )
-                    minTooFar = MaxTime;
-                else
-                    minTooFar = tooFar.front()->getTQTime();
-
-            } else {
-                typedef typename std::vector<Data>::iterator DataIter;
-                DataIter it = std::find(tooFar.begin(),tooFar.end(),node);
-
-                I(it != tooFar.end());
-                tooFar.erase(it);
-                I(std::find(tooFar.begin(),tooFar.end(),node) == tooFar.end());
-                std::make_heap(tooFar.begin(),tooFar.end(),dLess);
-            }
+            removeTooFar(node);
         } else if( node->isInFastQueue() ) {
             Time time = node->getTQTime();
 
@@ -282,6 +476,38 @@ public:
         }
     };
 
+    // Time of the first node in the queue (MaxTime if empty). With the
+    // timing wheel it is a lower bound.
+    Time nextTime() const {
+        Time time = minTooFar;
+
+        if(nNodes) {
+            for(uint32_t i = 0; i < AccessSize; i++) {
+                if(access[(minPos + i) & AccessMask]) {
+                    if(time > minTime + i)
+                        time = minTime + i;
+                    break;
+                }
+            }
+        }
+
+        return time;
+    };
+
+    // Moves the window to cTime after a jump in time. There should be no
+    // node before cTime.
+    void skipTo(Time cTime) {
+        I(nextTime() >= cTime);
+
+        if(nNodes == 0) {
+            minTime = cTime;
+            minPos = 0;
+        }
+
+        if(tooFarReady(cTime))
+            adjustTooFar();
+    };
+
     void reschedule(Data node, Time rTime) {
         remove(node);
 
@@ -290,12 +516,21 @@ public:
         insert(node,rTime);
     };
 
+#ifdef TQUEUE_WHEEL
+    size_t size() const {
+        return nNodes + nTooFar;
+    };
+    bool empty() const {
+        return nNodes == 0 && nTooFar == 0;
+    };
+#else
     size_t size() const {
         return nNodes + tooFar.size();
     };
     bool empty() const {
         return nNodes == 0 && tooFar.empty();
     };
+#endif
 
     void dump();
 };
@@ -123,6 +123,20 @@ public:
 	*/
 	static void advanceClock();
 
+    // First cycle with a scheduled callback (MaxTime if none)
+    static Time_t nextEventTime() {
+        return cbQ.nextTime();
+    }
+
+    // Jump to tim without calling advanceClock for the cycles in
+    // between. There should be no callback scheduled before tim.
+    static void skipClock(Time_t tim) {
+        I(tim >= globalClock);
+        I(nextEventTime() >= tim);
+        globalClock = tim;
+        cbQ.skipTo(tim);
+    }
+
     static bool empty() {
         return cbQ.empty();
     }